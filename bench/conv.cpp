@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <conv.h>
+#include <timer.h>
+#include "../tests/check.h"
+
+/**
+ * @brief conv2d (im2col + GEMM) against a naive direct convolution.
+ *
+ * For each case prints the forward time of both, the speedup, the largest
+ * output difference, and the time of conv2d's backward pass.
+ *
+ * Usage: bench_conv [repeats]
+ */
+
+namespace {
+
+struct Case {
+    std::string name;
+    int batch;
+    int filters;
+    ConvSpec spec;
+};
+
+ConvSpec spec2d(int channels, int height, int width, int kernel, int stride, int pad) {
+    ConvSpec s;
+    s.channels = channels;
+    s.height = height;
+    s.width = width;
+    s.kernel_h = s.kernel_w = kernel;
+    s.stride_h = s.stride_w = stride;
+    s.pad_h = s.pad_w = pad;
+    return s;
+}
+
+// Seven nested loops straight from the definition, same layouts as conv2d.
+void direct_conv(const Tensor &in, const Tensor &w, const ConvSpec &s, std::vector<float> &out) {
+    const int OH = s.out_h(), OW = s.out_w(), C = s.channels, F = w.cols;
+    out.assign(static_cast<size_t>(in.rows) * OH * OW * F, 0.0f);
+    for (int n = 0; n < in.rows; n++) {
+        for (int oh = 0; oh < OH; oh++) {
+            for (int ow = 0; ow < OW; ow++) {
+                for (int f = 0; f < F; f++) {
+                    float acc = 0.0f;
+                    for (int kh = 0; kh < s.kernel_h; kh++) {
+                        for (int kw = 0; kw < s.kernel_w; kw++) {
+                            const int ih = oh * s.stride_h - s.pad_h + kh * s.dilation_h;
+                            const int iw = ow * s.stride_w - s.pad_w + kw * s.dilation_w;
+                            if (ih < 0 || ih >= s.height || iw < 0 || iw >= s.width) {
+                                continue;
+                            }
+                            for (int c = 0; c < C; c++) {
+                                acc += in.data[n][(ih * s.width + iw) * C + c] * w.data[(kh * s.kernel_w + kw) * C + c][f];
+                            }
+                        }
+                    }
+                    out[((static_cast<size_t>(n) * OH + oh) * OW + ow) * F + f] = acc;
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    const int repeats = argc > 1 ? std::max(1, std::atoi(argv[1])) : 3;
+    std::vector<Case> cases = {
+        {"3x3 pad1 32x32x16 -> 32", 8, 32, spec2d(16, 32, 32, 3, 1, 1)},
+        {"5x5 stride2 64x64x3 -> 16", 8, 16, spec2d(3, 64, 64, 5, 2, 2)},
+        {"1x1 32x32x64 -> 64", 8, 64, spec2d(64, 32, 32, 1, 1, 0)},
+        {"1d k9 len1024x8 -> 16", 16, 16, ConvSpec::conv1d(8, 1024, 9, 1, 4)},
+    };
+
+    std::mt19937 gen(7);
+    std::printf("%-28s %10s %10s %8s %10s %12s %10s\n", "case", "direct ms", "im2col ms", "speedup", "GFLOP/s",
+                "max |diff|", "bwd ms");
+    for (const Case &c : cases) {
+        const ConvSpec &s = c.spec;
+        Value x = random_leaf(c.batch, s.height * s.width * s.channels, "x", gen(), 1.0f, MemCategory::Activation);
+        Value w = random_leaf(s.patch(), c.filters, "w", gen(), 1.0f);
+        const double flops = 2.0 * c.batch * s.out_h() * s.out_w() * s.patch() * c.filters;
+
+        std::vector<float> reference;
+        double direct_ms = 1e30, im2col_ms = 1e30, backward_ms = 1e30;
+        for (int r = 0; r < repeats; r++) {
+            Timer timer;
+            direct_conv(*x.ptr, *w.ptr, s, reference);
+            direct_ms = std::min(direct_ms, timer.stop());
+        }
+        double max_diff = 0.0;
+        for (int r = 0; r < repeats; r++) {
+            Timer timer;
+            Value y = conv2d(x, w, s);
+            im2col_ms = std::min(im2col_ms, timer.stop());
+
+            const int cols = y.ptr->cols;
+            for (int n = 0; n < y.ptr->rows; n++) {
+                for (int j = 0; j < cols; j++) {
+                    max_diff = std::max(max_diff, static_cast<double>(std::fabs(y.ptr->data[n][j] - reference[static_cast<size_t>(n) * cols + j])));
+                    y.ptr->grad[n][j] = 1.0f;
+                }
+            }
+            timer.reset();
+            y.ptr->propagate();
+            backward_ms = std::min(backward_ms, timer.stop());
+            x.ptr->setgradzero();
+            w.ptr->setgradzero();
+        }
+        std::printf("%-28s %10.2f %10.2f %7.2fx %10.2f %12.3g %10.2f\n", c.name.c_str(), direct_ms, im2col_ms,
+                    direct_ms / im2col_ms, flops / (im2col_ms * 1e6), max_diff, backward_ms);
+    }
+    return 0;
+}
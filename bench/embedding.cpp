@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <embedding.h>
+#include <timer.h>
+
+/**
+ * @brief Training step time of embedding() against one-hot(ids) * table
+ * as the vocabulary grows. The embedding step should stay flat; the
+ * one-hot step grows with vocab (and is skipped past --max-onehot rows).
+ *
+ * Usage: bench_embedding [steps] [dim] [batch] [max_onehot_vocab]
+ */
+
+namespace {
+
+Value make_table(int vocab, int dim, std::mt19937 &gen) {
+    std::uniform_real_distribution<float> dis(-0.1f, 0.1f);
+    std::vector<float> storage(static_cast<size_t>(vocab) * dim);
+    for (float &v : storage) v = dis(gen);
+    std::vector<float *> rows(vocab);
+    for (int i = 0; i < vocab; i++) {
+        rows[i] = storage.data() + static_cast<size_t>(i) * dim;
+    }
+    return Value(vocab, dim, rows.data(), "table", MemCategory::Parameter);
+}
+
+// Ids skewed towards small values, so batches repeat ids like real features.
+std::vector<int> batch_ids(int batch, int vocab, std::mt19937 &gen) {
+    std::geometric_distribution<int> dis(20.0 / vocab);
+    std::vector<int> ids(batch);
+    for (int &id : ids) id = std::min(dis(gen), vocab - 1);
+    return ids;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    const int steps = argc > 1 ? std::atoi(argv[1]) : 20;
+    const int dim = argc > 2 ? std::atoi(argv[2]) : 64;
+    const int batch = argc > 3 ? std::atoi(argv[3]) : 256;
+    const int max_onehot = argc > 4 ? std::atoi(argv[4]) : 10000;
+    const float learning_rate = 0.01f;
+
+    std::printf("steps=%d dim=%d batch=%d\n", steps, dim, batch);
+    std::printf("%10s %16s %16s\n", "vocab", "embedding(us)", "one-hot(us)");
+    std::mt19937 gen(11);
+    for (int vocab : {1000, 10000, 100000, 1000000}) {
+        Value table = make_table(vocab, dim, gen);
+
+        Timer timer;
+        for (int s = 0; s < steps; s++) {
+            Value loss = embedding(table, batch_ids(batch, vocab, gen)).mean();
+            loss.backward();
+            table.update_rows(learning_rate);
+        }
+        double embedding_us = timer.stop() * 1000.0 / steps;
+
+        if (vocab > max_onehot) {
+            std::printf("%10d %16.1f %16s\n", vocab, embedding_us, "skipped");
+            continue;
+        }
+        timer.reset();
+        for (int s = 0; s < steps; s++) {
+            std::vector<int> ids = batch_ids(batch, vocab, gen);
+            Value onehot(new Tensor(batch, vocab, nullptr, "onehot"));
+            for (int k = 0; k < batch; k++) {
+                onehot.ptr->data[k][ids[k]] = 1.0f;
+            }
+            Value loss = (onehot * table).mean();
+            loss.backward();
+            table.update(learning_rate);
+            table.setgradzero();
+        }
+        std::printf("%10d %16.1f %16.1f\n", vocab, embedding_us, timer.stop() * 1000.0 / steps);
+    }
+    return 0;
+}
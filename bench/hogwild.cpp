@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <hogwild.h>
+#include <timer.h>
+#include "../tests/check.h"
+
+/**
+ * @brief Throughput and convergence of HogwildTrainer on the sin(x) task
+ * from main.cpp, for 1, 2, 4, ... threads up to num_threads().
+ *
+ * One thread is plain synchronous minibatch SGD, so it is the baseline for
+ * both steps/s and the final loss. Every run starts from the same weights
+ * and sees the same minibatch for a given step index.
+ *
+ * The speedup column compares runs of this program with each other on the
+ * machine it runs on; it is not a scaling result. It only reflects
+ * multi-core scaling when every thread has a free core. With fewer cores,
+ * threads time-slice and the column shows contention overhead instead.
+ * The library is built with -pg even here, which adds a small per-call cost.
+ *
+ * Usage: bench_hogwild [steps] [hidden] [batch]
+ */
+
+namespace {
+
+const int NUM_POINTS = 100;
+
+// Features [x, 1] and target sin(x) for the given sample indices.
+void make_batch(const std::vector<int> &idx, std::vector<float> &x, std::vector<float> &y) {
+    x.resize(idx.size() * 2);
+    y.resize(idx.size());
+    for (size_t k = 0; k < idx.size(); k++) {
+        float v = static_cast<float>(idx[k]) / NUM_POINTS * 2.0f * static_cast<float>(M_PI);
+        x[2 * k] = v;
+        x[2 * k + 1] = 1.0f;
+        y[k] = std::sin(v);
+    }
+}
+
+float full_loss(Value &W1, Value &W2) {
+    std::vector<int> all(NUM_POINTS);
+    for (int i = 0; i < NUM_POINTS; i++) {
+        all[i] = i;
+    }
+    std::vector<float> x, y;
+    make_batch(all, x, y);
+    Value xv = leaf(NUM_POINTS, 2, x, "x", MemCategory::Activation);
+    Value yv = leaf(NUM_POINTS, 1, y, "y", MemCategory::Activation);
+    Value loss = ((xv * W1).leakyrelu() * W2).mse(yv);
+    float value = loss.item();
+    loss.backward();
+    W1.ptr->setgradzero();
+    W2.ptr->setgradzero();
+    return value;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    const int steps = argc > 1 ? std::atoi(argv[1]) : 4000;
+    const int hidden = argc > 2 ? std::atoi(argv[2]) : 256;
+    const int batch = argc > 3 ? std::atoi(argv[3]) : 16;
+    const float learning_rate = 0.01f;
+
+    std::vector<float> w1_init = random_values(2 * hidden, 42, 1.0f);
+    std::vector<float> w2_init = random_values(hidden, 43, 1.0f / std::sqrt(static_cast<float>(hidden)));
+
+    std::cout << "hogwild sin(x): steps=" << steps << " hidden=" << hidden << " batch=" << batch
+              << " max threads=" << num_threads() << "\n";
+    {
+        Value W1 = leaf(2, hidden, w1_init, "W1");
+        Value W2 = leaf(hidden, 1, w2_init, "W2");
+        std::cout << "initial mse " << full_loss(W1, W2) << "\n";
+    }
+    std::cout << "threads  steps/s   speedup  tail loss  final mse" << std::endl;
+
+    double baseline = 0.0;
+    for (int threads = 1;; threads *= 2) {
+        threads = std::min(threads, num_threads());
+        Value W1 = leaf(2, hidden, w1_init, "W1");
+        Value W2 = leaf(hidden, 1, w2_init, "W2");
+
+        HogwildConfig config;
+        config.threads = threads;
+        config.learning_rate = learning_rate;
+        HogwildTrainer trainer({&W1, &W2}, config);
+
+        Timer timer;
+        std::vector<float> losses = trainer.train(steps, [&](int, int step, const std::vector<Value> &p) {
+            std::mt19937 rng(step);
+            std::uniform_int_distribution<int> pick(0, NUM_POINTS - 1);
+            std::vector<int> idx(batch);
+            for (int &i : idx) i = pick(rng);
+            std::vector<float> x, y;
+            make_batch(idx, x, y);
+            Value xv = leaf(batch, 2, x, "x", MemCategory::Activation);
+            Value yv = leaf(batch, 1, y, "y", MemCategory::Activation);
+            Value loss = ((xv * p[0]).leakyrelu() * p[1]).mse(yv);
+            float value = loss.item();
+            loss.backward();
+            return value;
+        });
+        double seconds = timer.stop() / 1000.0;
+        double rate = steps / seconds;
+        if (threads == 1) {
+            baseline = rate;
+        }
+        // Minibatch losses are noisy; average the last tenth of the run.
+        int tail = std::max(1, steps / 10);
+        double tail_loss = 0.0;
+        for (int s = steps - tail; s < steps; s++) {
+            tail_loss += losses[s];
+        }
+        std::printf("%7d  %8.0f  %7.2fx  %9.5f  %9.5f\n", threads, rate, rate / baseline, tail_loss / tail,
+                    full_loss(W1, W2));
+        if (threads == num_threads()) {
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <static_tensor.h>
+#include <timer.h>
+#include "../tests/check.h"
+
+/**
+ * @brief ns per forward of the demo model, (x * W1).leakyrelu() * W2 with a
+ * 1 x 2 input and 64 hidden units, on three paths: Values only, Values with
+ * StaticTensor weights (still a graph), and StaticTensors only.
+ *
+ * Usage: bench_static_tensor [runs]
+ */
+
+namespace {
+
+float input_at(int run) {
+    return static_cast<float>(run % 8) * M_PI / 4;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    const int runs = argc > 1 ? std::atoi(argv[1]) : 100000;
+    Value W1 = random_leaf(2, 64, "W1", 7, 1.0f);
+    Value W2 = random_leaf(64, 1, "W2", 8, 1.0f);
+    auto w1 = StaticTensor<2, 64>::from(W1);
+    auto w2 = StaticTensor<64, 1>::from(W2);
+
+    float checksum = 0.0f;
+    Timer timer;
+    for (int run = 0; run < runs; run++) {
+        std::vector<float> x_values = {input_at(run), 1.0f};
+        Value x = leaf(1, 2, x_values, "x");
+        checksum += ((x * W1).leakyrelu() * W2).item();
+    }
+    double value_ns = timer.stop() * 1e6 / runs;
+
+    timer.reset();
+    for (int run = 0; run < runs; run++) {
+        std::vector<float> x_values = {input_at(run), 1.0f};
+        Value x = leaf(1, 2, x_values, "x");
+        checksum -= ((x * w1).leakyrelu() * w2).item();
+    }
+    double mixed_ns = timer.stop() * 1e6 / runs;
+
+    timer.reset();
+    for (int run = 0; run < runs; run++) {
+        StaticTensor<1, 2> x;
+        x[0][0] = input_at(run);
+        x[0][1] = 1.0f;
+        checksum += ((x * w1).leakyrelu() * w2)[0][0];
+    }
+    double static_ns = timer.stop() * 1e6 / runs;
+
+    std::printf("runs=%d\n", runs);
+    std::printf("%-26s %10.1f ns\n", "Value", value_ns);
+    std::printf("%-26s %10.1f ns\n", "Value * StaticTensor", mixed_ns);
+    std::printf("%-26s %10.1f ns\n", "StaticTensor", static_ns);
+    std::printf("checksum %g\n", checksum);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <iostream>
+
+/**
+ * @brief Where the pages of large tensor buffers are placed.
+ */
+enum class NumaPolicy {
+    Default,     // kernel default: pages land on the node of the thread that first writes them
+    FirstTouch,  // pre-fault whole (huge) pages from the pool in contiguous chunks, spreading a block over the workers' nodes
+    Interleave,  // round-robin pages across all nodes (mbind MPOL_INTERLEAVE)
+    Bind,        // all pages on bind_node (mbind MPOL_BIND)
+};
+
+const char* numa_policy_name(NumaPolicy policy);
+
+struct AllocConfig {
+    NumaPolicy numa = NumaPolicy::Default;
+    int bind_node = 0;
+    // Buffers of at least this many bytes are mmap'd 2 MB aligned and placed
+    // by `numa`; smaller ones come from the heap, 64-byte aligned.
+    size_t large_threshold = 2 << 20;
+    // madvise(MADV_HUGEPAGE) on large buffers.
+    bool huge_pages = true;
+};
+
+/**
+ * @brief Allocation policy for tensor storage.
+ *
+ * Every Tensor keeps its rows in one contiguous block from alloc_block().
+ * The configuration is read from the environment at startup and can be
+ * replaced at any time; it applies to blocks allocated afterwards. Reading
+ * it takes no lock, so it costs allocations nothing:
+ *
+ *   ESP_NUMA=default|first-touch|interleave|bind:<node>
+ *   ESP_HUGEPAGE_THRESHOLD=<bytes>   (large_threshold; 0 puts every buffer on the heap)
+ *   ESP_HUGEPAGES=0                  (no MADV_HUGEPAGE)
+ *
+ * If mbind or madvise are refused (single-node kernels, containers) the
+ * block is kept with default placement and counted as a fallback in
+ * report(). Thread pinning lives with the thread pool, see
+ * set_pin_threads() in parallel.h.
+ *
+ * FirstTouch balances a block's pages across the pool's workers. Pages are
+ * 2 MB once advised, so the split follows huge-page boundaries and does not
+ * line up with the row chunks of any particular kernel.
+ */
+class AllocPolicy {
+public:
+    static AllocConfig config();
+    static void configure(const AllocConfig& config);
+
+    // NUMA nodes with memory; 1 when the topology cannot be read.
+    static int numaNodes();
+
+    // Large-block counters since startup.
+    static size_t largeBlocks();
+    static size_t largeBytes();
+    static size_t hugePageBytes();
+    static size_t fallbacks();
+
+    static void report(std::ostream& os = std::cout);
+};
+
+struct MemBlock {
+    float* data = nullptr;
+    size_t bytes = 0;
+    bool mapped = false;  // from mmap rather than the heap
+};
+
+// Zeroed block of at least `bytes` bytes placed by the current AllocConfig.
+MemBlock alloc_block(size_t bytes);
+void free_block(const MemBlock& block);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <functional>
+#include <value.h>
+
+/**
+ * @brief A slice of the forward graph that is recomputed during backward
+ * instead of keeping its intermediates alive.
+ */
+typedef std::function<Value(const Value &)> Segment;
+
+/**
+ * @brief Run `segment` on `input` and keep only its output.
+ *
+ * The intermediates built inside the segment are released as soon as the
+ * forward returns. During backward the segment is replayed on the same
+ * input and its graph is back-propagated in place, so the input and any
+ * parameters the segment captures receive the same gradients as without
+ * checkpointing. The segment must be deterministic, and parameters used
+ * inside it should not also be used by ops outside it, otherwise the order
+ * of gradient clipping on those parameters can differ.
+ *
+ * @param segment Forward computation, typically one or more layers
+ * @param input Segment input; it must stay unmodified until backward
+ * @param enabled When false the segment runs as an ordinary part of the graph
+ * @return Segment output, usable like any other Value
+ */
+Value checkpoint(const Segment &segment, const Value &input, bool enabled = true);
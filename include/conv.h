@@ -0,0 +1,57 @@
+#pragma once
+
+#include <value.h>
+
+/**
+ * @brief Shape of a 2-D convolution over channels-last inputs.
+ *
+ * Every row of the input tensor is one sample laid out as H x W x C
+ * (row-major, channels fastest); every output row is OH x OW x F in the
+ * same layout, so convolutions chain without reshaping. The weight tensor
+ * is (KH * KW * C) x F, rows ordered by (kh, kw, c).
+ */
+struct ConvSpec {
+    int channels = 1, height = 1, width = 1;
+    int kernel_h = 1, kernel_w = 1;
+    int stride_h = 1, stride_w = 1;
+    int pad_h = 0, pad_w = 0;
+    int dilation_h = 1, dilation_w = 1;
+
+    int out_h() const { return (height + 2 * pad_h - dilation_h * (kernel_h - 1) - 1) / stride_h + 1; }
+    int out_w() const { return (width + 2 * pad_w - dilation_w * (kernel_w - 1) - 1) / stride_w + 1; }
+    int patch() const { return kernel_h * kernel_w * channels; }  // weight rows
+
+    // 1-D convolution over rows laid out as length x channels.
+    static ConvSpec conv1d(int channels, int length, int kernel, int stride = 1, int pad = 0, int dilation = 1) {
+        ConvSpec s;
+        s.channels = channels;
+        s.width = length;
+        s.kernel_w = kernel;
+        s.stride_w = stride;
+        s.pad_w = pad;
+        s.dilation_w = dilation;
+        return s;
+    }
+};
+
+/**
+ * @brief Convolution lowered to im2col + the operator* GEMM kernel.
+ *
+ * Patches of one sample at a time are unrolled into a (OH * OW) x patch()
+ * workspace, so the extra memory is bounded by a single sample. 1x1
+ * kernels with unit stride and no padding skip the unrolling and feed the
+ * input rows to the GEMM directly. Backward recomputes the patches rather
+ * than keeping them: dWeight = patches^T * dOut, and dInput scatters
+ * dOut * weight^T back through col2im.
+ *
+ * @param input N x (H * W * C)
+ * @param weight patch() x F
+ * @return N x (OH * OW * F)
+ * @throws std::invalid_argument if shapes do not match the spec
+ */
+Value conv2d(const Value &input, const Value &weight, const ConvSpec &spec);
+
+// Same as conv2d; named for specs built with ConvSpec::conv1d.
+inline Value conv1d(const Value &input, const Value &weight, const ConvSpec &spec) {
+    return conv2d(input, weight, spec);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <value.h>
+#include <parallel.h>
+
+struct DataParallelConfig {
+    int workers = num_threads();    // processes, including the calling one
+    size_t bucket_bytes = 1 << 20;  // gradient bytes reduced together
+    float learning_rate = 0.01f;
+};
+
+/**
+ * @brief Synchronous data-parallel SGD over forked worker processes.
+ *
+ * Every worker holds a full copy of the parameters (inherited at fork) and
+ * runs the step function on its shard of the batch. Parameter gradients are
+ * packed into buckets in a POSIX shared-memory segment as soon as backward
+ * finalises them; the last worker to fill a bucket averages it for everyone
+ * while the others carry on with their backward pass. Once all buckets are
+ * reduced each worker applies the same averaged update, so the copies stay
+ * identical without ever exchanging weights.
+ *
+ * Activation gradients are clipped per node, as in a single process.
+ * Parameter gradients are reduced unclipped and each average is clipped
+ * once before the update, so one worker matches a plain backward() and
+ * update() loop bit for bit when every parameter feeds a single op. With N
+ * workers an activation gradient is clipped by the norm of its shard
+ * rather than of the full batch, so the loss curve only matches while no
+ * activation gradient crosses a clipping bound, and stays close otherwise.
+ * A parameter used by several ops is clipped once in total, not once per
+ * op.
+ *
+ * The calling process is rank 0 and keeps the trained parameters.
+ */
+class DataParallelTrainer {
+public:
+    /**
+     * @brief Build the forward for this worker's shard, call backward() on
+     * the loss and return the loss value. Gradients must not be zeroed or
+     * applied by the step function.
+     */
+    typedef std::function<float(int rank, int world, int step)> StepFn;
+
+    DataParallelTrainer(std::vector<Value *> params, DataParallelConfig config = DataParallelConfig());
+
+    /**
+     * @brief Run `steps` synchronous steps across all workers
+     * @param on_step Optional callback run on rank 0 with the mean loss of each step
+     * @return Mean loss across workers for every step
+     * @throws std::runtime_error if shared memory setup fails or a worker dies
+     */
+    std::vector<float> train(int steps, const StepFn &step,
+                             const std::function<void(int, float)> &on_step = nullptr);
+
+private:
+    std::vector<Value *> params;
+    DataParallelConfig config;
+};
+
+/**
+ * @brief Rows [rank * n / world, (rank + 1) * n / world) of `v` as a new leaf.
+ * Shards of equal size make the averaged gradient equal to the full-batch one.
+ */
+Value shard_rows(const Value &v, int rank, int world, MemCategory category = MemCategory::Activation);
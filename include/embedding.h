@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include <value.h>
+
+/**
+ * @brief Embedding lookup: row k of the result is row ids[k] of `table`.
+ *
+ * Replaces one-hot(ids) * table. Forward copies ids.size() rows. Backward
+ * groups repeated ids and sums their gradient rows in parallel, so each
+ * touched row of the table gradient is written by exactly one thread. The
+ * touched rows are recorded in touched_rows so that Value::update_rows()
+ * applies and clears them. Neither pass looks at the other rows, so a
+ * step costs the same for any vocabulary size.
+ *
+ * @param table vocab x dim
+ * @param ids Row indices, repeats allowed
+ * @return ids.size() x dim
+ * @throws std::invalid_argument if an id is outside [0, vocab)
+ */
+Value embedding(const Value &table, const std::vector<int> &ids);
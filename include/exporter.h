@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <value.h>
+
+struct ExportOptions {
+    std::string function_name = "esp_model";
+    // Embed the traced input/output and a parity check against them.
+    bool self_test = true;
+};
+
+/**
+ * @brief Lower the forward graph of `output` into a standalone C++ source file.
+ *
+ * Must be called before backward(), which releases the graph. `input` is
+ * the leaf fed at inference time; every other leaf is treated as a constant
+ * and embedded as an aligned constexpr array. The generated function
+ *
+ *     void <function_name>(const float* in, float* out);
+ *
+ * takes row-major buffers of the traced input and output shapes, uses only
+ * stack buffers, and depends on nothing but the compiler. Matmuls keep the
+ * library's summation order and elementwise ops are fused into the loop of
+ * the matmul that feeds them, so results match the library bit for bit
+ * unless the generated file is built with -ffast-math or FMA contraction.
+ *
+ * With self_test, the file also defines <function_name>_self_test(),
+ * returning the number of mismatching output elements, and a main() that
+ * runs it when compiled with -DESP_EXPORT_SELF_TEST_MAIN (see the
+ * ESP_EXPORTED_MODEL option in CMakeLists.txt).
+ *
+ * Supported ops: matmul, +, -, leakyrelu.
+ *
+ * @throws std::invalid_argument on unsupported ops or an input that is not part of the graph
+ * @throws std::runtime_error if the file cannot be written
+ */
+void export_model(const Value &output, const Value &input, const std::string &path,
+                  const ExportOptions &options = ExportOptions());
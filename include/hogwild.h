@@ -0,0 +1,64 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <value.h>
+#include <parallel.h>
+
+enum class HogwildWrite {
+    // Relaxed atomic load and store per element: concurrent updates to the
+    // same weight can be lost, but no value is ever torn. Compiles to plain
+    // moves on x86, i.e. classic Hogwild.
+    Relaxed,
+    // Compare-and-swap loop per element: no update is lost, at the cost of
+    // retries under contention.
+    CompareExchange,
+};
+
+struct HogwildConfig {
+    int threads = num_threads();
+    float learning_rate = 0.01f;
+    HogwildWrite write = HogwildWrite::Relaxed;
+    // Apply only the rows listed in each replica's touched_rows when it has
+    // any (see Value::update_rows); for parameters fed by sparse ops only.
+    bool sparse_updates = false;
+};
+
+/**
+ * @brief Lock-free asynchronous SGD over threads sharing one copy of the
+ * parameters.
+ *
+ * Each worker thread gets a replica of every parameter: a leaf that reads
+ * the shared weights but accumulates into its own gradient buffer. Workers
+ * pull step indices from a shared counter, run the step function on their
+ * replicas and write the update straight into the shared weights without
+ * any lock or barrier, so a step may see weights that other workers are
+ * halfway through updating. Zero gradient entries are skipped, which keeps
+ * writes (and cache-line ping-pong) proportional to what a step touched.
+ *
+ * Kernels run single-threaded inside workers; all parallelism comes from
+ * the workers themselves.
+ */
+class HogwildTrainer {
+public:
+    /**
+     * @brief Build the forward on `params` (this worker's replicas, in the
+     * order given to the trainer), call backward() on the loss and return
+     * the loss value. Must not update or zero gradients, and must only use
+     * Values it created itself besides `params`.
+     */
+    typedef std::function<float(int worker, int step, const std::vector<Value> &params)> StepFn;
+
+    HogwildTrainer(std::vector<Value *> params, HogwildConfig config = HogwildConfig());
+
+    /**
+     * @brief Run `steps` steps in total, spread across the worker threads
+     * @return Loss of every step, indexed by step
+     * @throws whatever the step function threw first, once all workers stopped
+     */
+    std::vector<float> train(int steps, const StepFn &step);
+
+private:
+    std::vector<Value *> params;
+    HogwildConfig config;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <value.h>
+
+struct ExprNode;
+
+/**
+ * @brief Deferred chain of elementwise ops over same-shaped tensors.
+ *
+ * Building a LazyExpr only records the op; nothing is allocated or computed
+ * until it is materialised by eval(), by converting it to a Value, or by
+ * feeding it to a matmul or reduction. Materialising runs the whole chain
+ * as one fused pass: inputs are read once, the result is written once, and
+ * intermediates only ever live in a small per-thread tile buffer.
+ *
+ * The autograd graph sees a single fused node whose backward recomputes the
+ * chain tile by tile and pushes exact gradients to every input. Unlike the
+ * eager ops, intermediate gradients inside the chain are not clipped; only
+ * the gradients landing in the inputs are.
+ *
+ * @code
+ * Value h = (lazy(A) + B - C).leakyrelu();   // one loop, one allocation
+ * Value out = (lazy(x1) + x2) * W;           // materialised by the matmul
+ * @endcode
+ */
+class LazyExpr {
+private:
+    std::shared_ptr<const ExprNode> node;
+    int rows, cols;
+
+    LazyExpr(std::shared_ptr<const ExprNode> node, int rows, int cols);
+    LazyExpr binary(int kind, const LazyExpr &other, const char *op) const;
+
+public:
+    LazyExpr(const Value &v);
+
+    LazyExpr operator+(const LazyExpr &other) const;
+    LazyExpr operator-(const LazyExpr &other) const;
+    LazyExpr operator/(const LazyExpr &other) const;
+    LazyExpr hadamard(const LazyExpr &other) const;  // elementwise product
+    LazyExpr leakyrelu(float leaky = 0.01f) const;
+
+    // Run the fused loop and return the result as a graph node.
+    Value eval() const;
+    operator Value() const { return eval(); }
+
+    Value operator*(const Value &other) const { return eval() * other; }
+    Value sum(int axis = -1) const { return eval().sum(axis); }
+    Value mean(int axis = -1) const { return eval().mean(axis); }
+    Value mse(const Value &target) const { return eval().mse(target); }
+};
+
+inline LazyExpr lazy(const Value &v)
+{
+    return LazyExpr(v);
+}
@@ -4,15 +4,58 @@
 #include <string.h>
 #include <stdexcept>
 #include <set>
+#include <algorithm>
 #include <vector>
 #include <uuid/uuid.h>
 #include <functional>
 #include <memory>
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
+#include "memory_stats.h"
+#include "alloc_policy.h"
 
 typedef float float32;
 
+class Tensor;
+
+/**
+ * @brief Per-node state for ops whose backward needs more than the two
+ * input pointers. A node with `_backward = &Tensor::backcontext` hands its
+ * backward pass to ctx->backward().
+ */
+struct OpContext {
+    virtual ~OpContext() = default;
+    virtual void backward(Tensor& node) = 0;
+};
+
+// Rescales a gradient into [MIN_GRAD_NORM, CLIP_NORM] by its L2 norm.
+void clip_gradient(float** grad, int rows, int cols);
+// Same, with the norm taken over `row_ids` only; the other rows must be zero.
+void clip_gradient_rows(float** grad, const std::vector<int>& row_ids, int cols);
+
+// Per-thread switch for both clip functions, on by default.
+void set_gradient_clipping(bool on);
+bool gradient_clipping();
+// Per-thread list of gradient buffers both clip functions skip, so their
+// owner can clip them later; data-parallel workers defer the parameter
+// gradients until they are averaged. Empty by default.
+void set_deferred_clipping(std::vector<float**> grads);
+
+// Row-pointer GEMM kernels behind operator* and backmul. They accumulate
+// into C, and every C[i][j] adds its K products in increasing k order, so
+// results do not depend on the thread count.
+void gemm_nn(const float* const* A, const float* const* B, float** C, int M, int K, int N);  // C += A * B, A is M x K
+void gemm_nt(const float* const* A, const float* const* B, float** C, int M, int K, int N);  // C += A * B^T, B is N x K
+void gemm_tn(const float* const* A, const float* const* B, float** C, int M, int K, int N);  // C += A^T * B, A is K x M
+
+/**
+ * @brief Called by Tensor::propagate() for every leaf once its gradient is
+ * final, i.e. after all nodes that consume it have run their backward.
+ * Hooks are per thread; pass an empty function to remove it.
+ */
+typedef std::function<void(Tensor&)> GradReadyHook;
+void set_grad_ready_hook(GradReadyHook hook);
+
 class Tensor : public boost::intrusive_ref_counter<Tensor> {
     typedef float float32;
 public:
@@ -20,14 +63,50 @@ public:
     int rows, cols, batch;
     boost::intrusive_ptr<Tensor> left;
     boost::intrusive_ptr<Tensor> right;
+    std::vector<boost::intrusive_ptr<Tensor>> extra_inputs;  // inputs beyond left/right of n-ary ops
     float32** data;  
     float32** grad;  
     void (Tensor::*_backward)() = nullptr; 
+    std::shared_ptr<OpContext> ctx;
     std::string name;
     std::string uuidstr;
+    MemCategory category = MemCategory::Activation;
+    float32 leaky = 0.01f;  // slope recorded by lekyrelu for its backward
+    // Sorted rows of grad written by sparse ops since the last update_rows().
+    std::vector<int> touched_rows;
 private:
     std::shared_ptr<float32*[]> data_holder;  
     std::shared_ptr<float32*[]> grad_holder;  
+    bool graph_node = false;
+
+    // Allocates zeroed rows, contiguous in one block placed by AllocPolicy,
+    // and reports them to MemoryStats under the current AllocSiteScope; the
+    // deleter reports the release.
+    static std::shared_ptr<float32*[]> alloc_rows(int r, int c, MemCategory cat) {
+        MemSite* site = AllocSiteScope::current();
+        size_t bytes = static_cast<size_t>(r) * c * sizeof(float32);
+        MemBlock block = alloc_block(bytes);
+        std::shared_ptr<float32*[]> holder(new float32*[r],
+            [cat, site, bytes, block](float32** p) {
+                free_block(block);
+                delete[] p;
+                MemoryStats::release(cat, site, bytes);
+            });
+        for (int i = 0; i < r; i++) {
+            holder[i] = block.data + static_cast<size_t>(i) * c;
+        }
+        MemoryStats::allocate(cat, site, bytes);
+        return holder;
+    }
+
+    void setGraphNode(bool node) {
+        if (node && !graph_node) {
+            MemoryStats::graphNodeCreated();
+        } else if (!node && graph_node) {
+            MemoryStats::graphNodeReleased();
+        }
+        graph_node = node;
+    }
 
 public:
     Tensor() {
@@ -43,26 +122,15 @@ public:
         this->left = nullptr;
         this->right = nullptr;
 
-        data_holder = std::shared_ptr<float32*[]>(new float32*[1],
-            [](float32** p) {
-                delete[] p[0];
-                delete[] p;
-            });
-        
-        grad_holder = std::shared_ptr<float32*[]>(new float32*[1],
-            [](float32** p) {
-                delete[] p[0];
-                delete[] p;
-            });
+        data_holder = alloc_rows(1, 1, category);
+        grad_holder = alloc_rows(1, 1, MemCategory::Gradient);
 
         data = data_holder.get();
         grad = grad_holder.get();
-
-        data[0] = new float32[1]();  
-        grad[0] = new float32[1]();  
     }
 
-    Tensor(int rows, int cols, float32** input_data = nullptr, std::string name = "") {
+    Tensor(int rows, int cols, float32** input_data = nullptr, std::string name = "",
+           MemCategory category = MemCategory::Activation) {
         uuid_generate(id);
         char uuid_str[37];
         uuid_unparse(id, uuid_str);
@@ -71,34 +139,19 @@ public:
         this->rows = rows;
         this->cols = cols;
         this->name = name;
+        this->category = category;
         this->_backward = nullptr;
         this->left = nullptr;
         this->right = nullptr;
 
-        int r = rows;
-        data_holder = std::shared_ptr<float32*[]>(new float32*[r], 
-            [r](float32** p) {
-                for (int i = 0; i < r; i++) {
-                    delete[] p[i];
-                }
-                delete[] p;
-            });
-        
-        grad_holder = std::shared_ptr<float32*[]>(new float32*[r],
-            [r](float32** p) {
-                for (int i = 0; i < r; i++) {
-                    delete[] p[i];
-                }
-                delete[] p;
-            });
+        data_holder = alloc_rows(rows, cols, category);
+        grad_holder = alloc_rows(rows, cols, MemCategory::Gradient);
 
         data = data_holder.get();
         grad = grad_holder.get();
 
-        for (int j = 0; j < rows; j++) {
-            data[j] = new float32[cols]();  
-            grad[j] = new float32[cols](); 
-            if (input_data) {
+        if (input_data) {
+            for (int j = 0; j < rows; j++) {
                 memcpy(data[j], input_data[j], cols * sizeof(float32));
             }
         }
@@ -114,35 +167,25 @@ public:
         this->rows = t.rows;
         this->cols = t.cols;
         this->name = t.name;
+        this->category = t.category;
+        this->leaky = t.leaky;
+        this->touched_rows = t.touched_rows;
         this->_backward = t._backward;
+        this->ctx = t.ctx;
         
         // Copy child pointers
         this->left = t.left;
         this->right = t.right;
+        this->extra_inputs = t.extra_inputs;
+        setGraphNode(t.graph_node);
 
-        int r = rows;
-        data_holder = std::shared_ptr<float32*[]>(new float32*[r],
-            [r](float32** p) {
-                for (int i = 0; i < r; i++) {
-                    delete[] p[i];
-                }
-                delete[] p;
-            });
-        
-        grad_holder = std::shared_ptr<float32*[]>(new float32*[r],
-            [r](float32** p) {
-                for (int i = 0; i < r; i++) {
-                    delete[] p[i];
-                }
-                delete[] p;
-            });
+        data_holder = alloc_rows(rows, cols, category);
+        grad_holder = alloc_rows(rows, cols, MemCategory::Gradient);
 
         data = data_holder.get();
         grad = grad_holder.get();
 
         for (int j = 0; j < rows; j++) {
-            data[j] = new float32[cols];
-            grad[j] = new float32[cols];
             if (t.data && t.data[j]) {
                 memcpy(data[j], t.data[j], cols * sizeof(float32));
             }
@@ -159,35 +202,100 @@ public:
         this->rows = t.rows;
         this->cols = t.cols;
         this->name = std::move(t.name);
+        this->category = t.category;
+        this->leaky = t.leaky;
+        this->touched_rows = std::move(t.touched_rows);
         this->_backward = t._backward;
+        this->ctx = std::move(t.ctx);
         this->left = std::move(t.left);
         this->right = std::move(t.right);
+        this->extra_inputs = std::move(t.extra_inputs);
         this->data_holder = std::move(t.data_holder);
         this->grad_holder = std::move(t.grad_holder);
         this->data = this->data_holder.get();
         this->grad = this->grad_holder.get();
         
+        this->graph_node = t.graph_node;
+        
         t.data = nullptr;
         t.grad = nullptr;
         t.rows = 0;
         t.cols = 0;
+        t.graph_node = false;
+    }
+
+    ~Tensor() {
+        setGraphNode(false);
     }
 
     void setGrad(float32** new_grad) {
-        int r = rows;
-        grad_holder = std::shared_ptr<float32*[]>(new float32*[r],
-            [r](float32** p) {
-                for (int i = 0; i < r; i++) {
-                    delete[] p[i];
-                }
-                delete[] p;
-            });
+        grad_holder = alloc_rows(rows, cols, MemCategory::Gradient);
         grad = grad_holder.get();
         for (int j = 0; j < rows; j++) {
-            grad[j] = new float32[cols];
             memcpy(grad[j], new_grad[j], cols * sizeof(float32));
         }
     }
+
+    // Record the inputs of an op result so backward() can reach them.
+    void link(const Tensor* l, const Tensor* r = nullptr) {
+        left = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(l));
+        right = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(r));
+        setGraphNode(l || r);
+    }
+
+    // Same for ops with any number of inputs: the first two go to
+    // left/right, the rest to extra_inputs.
+    void link(const std::vector<const Tensor*>& inputs) {
+        link(inputs.size() > 0 ? inputs[0] : nullptr, inputs.size() > 1 ? inputs[1] : nullptr);
+        extra_inputs.clear();
+        for (size_t i = 2; i < inputs.size(); i++) {
+            extra_inputs.push_back(boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(inputs[i])));
+        }
+    }
+
+    // k-th input in link() order.
+    Tensor* input(size_t k) const {
+        return k == 0 ? left.get() : k == 1 ? right.get() : extra_inputs[k - 2].get();
+    }
+
+    // Drop the references to the inputs once backward() is done with them.
+    void unlink() {
+        left = nullptr;
+        right = nullptr;
+        extra_inputs.clear();
+        _backward = nullptr;
+        ctx = nullptr;
+        setGraphNode(false);
+    }
+
+    /**
+     * @brief New leaf tensor that shares this tensor's data and grad storage.
+     * Gradients accumulated into the alias land directly in this tensor.
+     */
+    Tensor* alias() const {
+        Tensor* a = new Tensor();
+        a->rows = rows;
+        a->cols = cols;
+        a->name = name;
+        a->category = category;
+        a->data_holder = data_holder;
+        a->grad_holder = grad_holder;
+        a->data = data;
+        a->grad = grad;
+        return a;
+    }
+
+    /**
+     * @brief New leaf that shares this tensor's data but owns a zeroed grad.
+     * Lets several threads build graphs over the same weights without
+     * accumulating into each other's gradients.
+     */
+    Tensor* replica() const {
+        Tensor* r = alias();
+        r->grad_holder = alloc_rows(rows, cols, MemCategory::Gradient);
+        r->grad = r->grad_holder.get();
+        return r;
+    }
     Tensor& operator=(const Tensor& t);
     Tensor operator+(const Tensor& t) const;
     Tensor operator/(const Tensor& t) const;
@@ -197,12 +305,30 @@ public:
     
     Tensor lekyrelu(float leaky = 0.01);
 
+    // Reductions: axis -1 reduces to 1x1, axis 0 to 1 x cols, axis 1 to rows x 1.
+    Tensor sum(int axis = -1) const;
+    Tensor mean(int axis = -1) const;
+
+    // Fused losses returning a 1x1 tensor. The target is treated as a
+    // constant and receives no gradient.
+    Tensor mse(const Tensor& target) const;            // mean over all elements
+    Tensor cross_entropy(const Tensor& target) const;  // log-softmax per row, mean over rows
+
     void backadd();
     void backmul();
+    // Seeds a 1x1 sum/mean/loss root whose grad is still zero with 1, then propagates.
     void backward();
+    // Sets the grad of a 1x1 root to `seed`, then propagates.
+    void backward(float seed);
+    void propagate();
     void backdot();
     void backsub();
     void backleakyrelu();
+    void backsum();
+    void backmean();
+    void backmse();
+    void backcrossentropy();
+    void backcontext();
 
     void update(float32 learning_rate) {
         for (int i = 0; i < this->rows; i++) {
@@ -217,6 +343,32 @@ public:
                 grad[i][j] = 0;
             }
         }
+        touched_rows.clear();
+    }
+
+    // Record rows (sorted, unique) that a sparse op accumulated into.
+    void mark_rows(const std::vector<int>& sorted_rows) {
+        std::vector<int> merged;
+        merged.reserve(touched_rows.size() + sorted_rows.size());
+        std::set_union(touched_rows.begin(), touched_rows.end(),
+                       sorted_rows.begin(), sorted_rows.end(), std::back_inserter(merged));
+        touched_rows.swap(merged);
+    }
+
+    /**
+     * @brief SGD step over touched_rows only, zeroing their gradient after.
+     * Cost scales with the rows sparse ops touched instead of the full
+     * tensor. Only valid when every gradient of this tensor comes from
+     * sparse ops, since dense contributions to other rows are not tracked.
+     */
+    void update_rows(float32 learning_rate) {
+        for (int i : touched_rows) {
+            for (int j = 0; j < this->cols; j++) {
+                data[i][j] -= learning_rate * grad[i][j];
+                grad[i][j] = 0;
+            }
+        }
+        touched_rows.clear();
     }
     
     bool operator<(const Tensor& t) const {
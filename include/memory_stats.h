@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief What a tracked buffer is used for.
+ *
+ * Tensor data is tagged with the category given at construction; gradient
+ * buffers are always counted as Gradient.
+ */
+enum class MemCategory {
+    Parameter,
+    Activation,
+    Gradient,
+    Workspace,
+    Count
+};
+
+const char* category_name(MemCategory category);
+
+struct SiteUsage {
+    std::string site;
+    MemCategory category;
+    size_t live_bytes;
+    size_t peak_bytes;
+    long live_allocations;
+};
+
+// Interned allocation site; see MemoryStats::site().
+struct MemSite;
+
+/**
+ * @brief Process-wide live/peak byte accounting for tensor buffers.
+ *
+ * Sites are the op that allocated the buffer (see AllocSiteScope), or
+ * "user" for tensors built directly by the caller. A site name is interned
+ * once into a MemSite; after that, allocate() and release() only update
+ * relaxed atomics, with no lock and no lookup.
+ *
+ * Graph nodes are tensors that still hold references to their inputs. A
+ * non-zero count once all user Values are gone means graphs were leaked.
+ *
+ * Setting ESP_MEMSTATS=1 prints report() at exit.
+ */
+class MemoryStats {
+public:
+    // Intern a site name; the same text always yields the same MemSite.
+    static MemSite* site(const char* name);
+
+    static void allocate(MemCategory category, MemSite* site, size_t bytes);
+    static void release(MemCategory category, MemSite* site, size_t bytes);
+
+    // Same, resolving `site` through the calling thread's site cache.
+    static void allocate(MemCategory category, const char* site, size_t bytes);
+    static void release(MemCategory category, const char* site, size_t bytes);
+
+    static size_t live(MemCategory category);
+    static size_t peak(MemCategory category);
+    static size_t liveTotal();
+    static size_t peakTotal();
+
+    // Per-site usage sorted by live bytes, largest first.
+    static std::vector<SiteUsage> sites();
+
+    // Restart peak tracking from the current live values.
+    static void resetPeak();
+
+    static void graphNodeCreated();
+    static void graphNodeReleased();
+    static long liveGraphNodes();
+
+    static void report(std::ostream& os = std::cout);
+};
+
+/**
+ * @brief Names the allocation site for tensors created on this thread
+ * while the scope is alive.
+ *
+ * Names are resolved through a small per-thread cache keyed by the
+ * literal's address, so entering a scope is a couple of loads once the
+ * site has been seen.
+ */
+class AllocSiteScope {
+private:
+    MemSite* previous;
+
+    static MemSite*& slot() {
+        thread_local MemSite* site = nullptr;
+        return site;
+    }
+
+    static MemSite* resolve(const char* name);
+
+public:
+    explicit AllocSiteScope(const char* site) : previous(slot()) {
+        slot() = resolve(site);
+    }
+
+    ~AllocSiteScope() {
+        slot() = previous;
+    }
+
+    AllocSiteScope(const AllocSiteScope&) = delete;
+    AllocSiteScope& operator=(const AllocSiteScope&) = delete;
+
+    static MemSite* current() {
+        MemSite* site = slot();
+        return site ? site : resolve("user");
+    }
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <functional>
+
+/**
+ * @brief Number of threads used by parallel kernels.
+ *
+ * Defaults to std::thread::hardware_concurrency(); ESP_NUM_THREADS
+ * overrides it.
+ */
+int num_threads();
+
+/**
+ * @brief Make parallel_for / parallel_reduce run everything on the calling
+ * thread. Worker processes that already own a core each turn this on.
+ */
+void set_parallel_inline(bool on);
+
+/**
+ * @brief Same as set_parallel_inline, for the calling thread only. For
+ * threads that already own a core, e.g. asynchronous SGD workers.
+ */
+void set_thread_inline(bool on);
+
+/**
+ * @brief Pin pool worker k to the k-th CPU the process may run on, so the
+ * pages they first touch (see NumaPolicy::FirstTouch) stay local to them.
+ * Read when the pool starts, i.e. before the first parallel kernel; the
+ * ESP_PIN_THREADS=1 environment variable turns it on from the start.
+ */
+void set_pin_threads(bool on);
+bool pin_threads();
+
+/**
+ * @brief Split [begin, end) into contiguous chunks and run fn(chunk_begin, chunk_end)
+ * on the shared worker pool; the calling thread works on chunks too.
+ *
+ * Ranges shorter than 2 * min_chunk run inline, so tiny tensors never pay
+ * for a thread hand-off. Chunks never overlap, so fn may write to disjoint
+ * rows without synchronisation.
+ */
+void parallel_for(int begin, int end, int min_chunk, const std::function<void(int, int)>& fn);
+
+/**
+ * @brief Like parallel_for, but each chunk returns a partial result and the
+ * partials are added in chunk order, so the result only depends on the
+ * thread count, not on scheduling.
+ */
+double parallel_reduce(int begin, int end, int min_chunk, const std::function<double(int, int)>& fn);
+
+/**
+ * @brief Rows per chunk that keep each chunk around `elements` floats.
+ */
+inline int rows_per_chunk(int cols, int elements = 1 << 14) {
+    return cols > 0 && cols < elements ? elements / cols : 1;
+}
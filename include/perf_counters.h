@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+enum class PerfCounter {
+    Cycles,
+    Instructions,
+    LLCMisses,
+    BranchMisses,
+    Count
+};
+
+const char* counter_name(PerfCounter counter);
+
+/**
+ * @brief Running totals of the hardware counters of the calling thread.
+ * `valid` marks the counters that could be opened; the others read zero.
+ */
+struct CounterValues {
+    static constexpr int N = static_cast<int>(PerfCounter::Count);
+    uint64_t value[N] = {};
+    bool valid[N] = {};
+
+    uint64_t operator[](PerfCounter c) const { return value[static_cast<int>(c)]; }
+};
+
+/**
+ * @brief Opt-in Linux perf_event_open counters for ops, backward nodes and
+ * training steps.
+ *
+ * Each thread opens its own counter group (user space only, so the default
+ * perf_event_paranoid=2 is enough) the first time it is measured. When
+ * enabled, every ProfileScope (i.e. every op and backward node) and every
+ * CounterScope adds its counter deltas, wall time, FLOPs and bytes to a
+ * per-label table, from which printSummary() derives IPC, achieved GFLOP/s,
+ * bytes per FLOP and misses per thousand instructions.
+ *
+ * Where perf_event_open is refused (containers, seccomp, VMs without a
+ * PMU) counters are reported as n/a and only the time-based columns are
+ * filled; nothing else changes. Like the profiler, totals are inclusive:
+ * a backward node's counts also appear under "backward".
+ *
+ * Counters follow the calling thread only, so work that parallel_for hands
+ * to pool workers is missing from an op's counts (but not from its time);
+ * run with ESP_NUM_THREADS=1 for exact per-op attribution.
+ *
+ * Setting ESP_PERF_COUNTERS=1 enables counting at startup and prints the
+ * summary at exit.
+ */
+class PerfCounters {
+public:
+    static void enable(bool on = true) {
+        enabled_flag().store(on, std::memory_order_relaxed);
+    }
+
+    static bool enabled() {
+        return enabled_flag().load(std::memory_order_relaxed);
+    }
+
+    // Opens the calling thread's counters if needed; false if none could be opened.
+    static bool available();
+
+    // Why counters are unavailable on the calling thread, or "" if they are not.
+    static std::string unavailableReason();
+
+    static void read(CounterValues& out);
+
+    static void record(const char* label, const CounterValues& start, const CounterValues& end,
+                       int64_t ns, double flops, double bytes);
+
+    static void reset();
+
+    static void printSummary(std::ostream& os = std::cout);
+
+private:
+    static std::atomic<bool>& enabled_flag() {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+};
+
+/**
+ * @brief RAII scope that counts everything run inside it under `label`
+ * when PerfCounters is enabled, e.g. a whole training step.
+ *
+ * The FLOPs and bytes of every ProfileScope (op or backward node) that
+ * finishes inside it on the same thread are added to its own, so a step
+ * scope reports GFLOP/s and bytes/FLOP without being told the model's
+ * cost. Scopes nest; each enclosing scope receives the totals.
+ */
+class CounterScope {
+private:
+    const char* label;
+    double flops;
+    double bytes;
+    bool active;
+    int64_t start_ns = 0;
+    CounterValues start;
+    CounterScope* parent = nullptr;
+
+    static CounterScope*& innermost() {
+        thread_local CounterScope* scope = nullptr;
+        return scope;
+    }
+
+public:
+    CounterScope(const char* label, double flops = 0.0, double bytes = 0.0);
+    ~CounterScope();
+
+    CounterScope(const CounterScope&) = delete;
+    CounterScope& operator=(const CounterScope&) = delete;
+
+    // FLOPs and bytes only known once the work is done.
+    void add(double more_flops, double more_bytes = 0.0) {
+        flops += more_flops;
+        bytes += more_bytes;
+    }
+
+    // Add to every active scope of the calling thread; called by ProfileScope.
+    static void attribute(double op_flops, double op_bytes) {
+        for (CounterScope* s = innermost(); s; s = s->parent) {
+            s->add(op_flops, op_bytes);
+        }
+    }
+};
@@ -0,0 +1,144 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include "perf_counters.h"
+
+/**
+ * @brief One recorded op invocation.
+ *
+ * Shapes are stored as {rows, cols} for the result and up to two operands;
+ * unused operand slots stay at zero.
+ */
+struct ProfileEvent {
+    const char* op = nullptr;
+    int out_shape[2] = {0, 0};
+    int lhs_shape[2] = {0, 0};
+    int rhs_shape[2] = {0, 0};
+    uint32_t tid = 0;
+    int64_t start_ns = 0;
+    int64_t end_ns = 0;
+    double flops = 0.0;
+    double bytes = 0.0;
+};
+
+/**
+ * @brief Opt-in per-op profiler for Tensor forward ops and backward nodes.
+ *
+ * Every thread records into its own fixed-size ring buffer, so the hot path
+ * is a relaxed load of the enable flag plus one buffer write. When the ring
+ * is full the oldest events are overwritten.
+ *
+ * Setting ESP_PROFILE=<path> in the environment enables the profiler at
+ * startup and, at exit, writes a Chrome trace to <path> and prints the
+ * per-op summary to stdout.
+ *
+ * Export (writeChromeTrace / printSummary) is meant to run while no ops are
+ * in flight, e.g. between training steps or at exit.
+ */
+class Profiler {
+public:
+    static constexpr size_t RING_CAPACITY = 1 << 16;
+
+    static void enable(bool on = true) {
+        enabled_flag().store(on, std::memory_order_relaxed);
+    }
+
+    static bool enabled() {
+        return enabled_flag().load(std::memory_order_relaxed);
+    }
+
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void record(const ProfileEvent& ev);
+
+    // Drop every recorded event; ring buffers stay registered.
+    static void reset();
+
+    /**
+     * @brief Write all recorded events as Chrome trace_event JSON
+     * (load it in chrome://tracing or Perfetto)
+     * @return false if the file could not be opened
+     */
+    static bool writeChromeTrace(const std::string& path);
+
+    /**
+     * @brief Print calls, inclusive and self time, FLOPs and bytes
+     * aggregated per op. The share column is each op's fraction of the
+     * total self time, so nested ops are not counted twice.
+     */
+    static void printSummary(std::ostream& os = std::cout);
+
+private:
+    static std::atomic<bool>& enabled_flag() {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+};
+
+/**
+ * @brief RAII scope that records one ProfileEvent when the profiler is on,
+ * and the op's hardware counters when PerfCounters is on.
+ *
+ * Construction is free apart from two flag checks when both are disabled.
+ */
+class ProfileScope {
+private:
+    ProfileEvent ev;
+    bool active;
+    bool counting;
+    CounterValues counters;
+
+public:
+    ProfileScope(const char* op, double flops = 0.0, double bytes = 0.0)
+        : active(Profiler::enabled()), counting(PerfCounters::enabled()) {
+        if (!active && !counting) {
+            return;
+        }
+        ev.op = op;
+        ev.flops = flops;
+        ev.bytes = bytes;
+        ev.start_ns = Profiler::now_ns();
+        if (counting) {
+            PerfCounters::read(counters);
+        }
+    }
+
+    ~ProfileScope() {
+        if (!active && !counting) {
+            return;
+        }
+        CounterValues end;
+        if (counting) {
+            PerfCounters::read(end);
+        }
+        ev.end_ns = Profiler::now_ns();
+        if (counting) {
+            PerfCounters::record(ev.op, counters, end, ev.end_ns - ev.start_ns, ev.flops, ev.bytes);
+            CounterScope::attribute(ev.flops, ev.bytes);
+        }
+        if (active) {
+            Profiler::record(ev);
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    void shapes(int out_r, int out_c, int lhs_r = 0, int lhs_c = 0, int rhs_r = 0, int rhs_c = 0) {
+        if (!active) {
+            return;
+        }
+        ev.out_shape[0] = out_r;
+        ev.out_shape[1] = out_c;
+        ev.lhs_shape[0] = lhs_r;
+        ev.lhs_shape[1] = lhs_c;
+        ev.rhs_shape[0] = rhs_r;
+        ev.rhs_shape[1] = rhs_c;
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <value.h>
+
+struct SnapshotStats {
+    long requested = 0;   // snapshot() calls
+    long written = 0;     // files durably renamed into place
+    long superseded = 0;  // snapshots replaced by a newer one before being written
+    long failed = 0;
+    double last_stall_ms = 0.0;  // time snapshot() held up the caller
+    double max_stall_ms = 0.0;
+    double total_stall_ms = 0.0;
+    double last_write_ms = 0.0;  // background write + fsync + rename
+    int64_t last_written_step = -1;
+    size_t bytes_in_flight = 0;  // size of the file being written, 0 when idle
+    size_t bytes_done = 0;       // of which already written
+    std::string last_error;
+};
+
+/**
+ * @brief Saves training state to disk without stalling the training loop.
+ *
+ * snapshot() only copies the registered tensors into a staging buffer
+ * (one memcpy per row) and returns; a background thread writes the copy
+ * to "<path>.tmp", fsyncs it, renames it over <path> and fsyncs the
+ * directory, so <path> always holds the last complete snapshot. If the
+ * writer is still busy, the newest snapshot waits for it and older pending
+ * ones are dropped (counted as superseded); the caller never waits for I/O.
+ *
+ * Register parameters, and any optimizer state kept in tensors, with add()
+ * before the first snapshot. restore() loads them back bit for bit along
+ * with the step and an opaque user state (e.g. a serialised RNG), which is
+ * all a deterministic loop needs to resume exactly where it left off.
+ */
+class AsyncCheckpointer {
+public:
+    explicit AsyncCheckpointer(const std::string &path);
+
+    // Waits for the in-flight write, then stops the writer thread.
+    ~AsyncCheckpointer();
+
+    AsyncCheckpointer(const AsyncCheckpointer &) = delete;
+    AsyncCheckpointer &operator=(const AsyncCheckpointer &) = delete;
+
+    /**
+     * @brief Track a tensor; `name` defaults to the tensor's name
+     * @throws std::invalid_argument on a duplicate name or after the first snapshot
+     */
+    void add(const Value &v, const std::string &name = "");
+
+    // Copy every tracked tensor and queue the copy for writing.
+    void snapshot(int64_t step, const std::string &user_state = "");
+
+    // Block until nothing is queued or being written; false if the last write failed.
+    bool wait();
+
+    SnapshotStats stats() const;
+
+    /**
+     * @brief Load <path> into the tracked tensors
+     * @param step Receives the step passed to snapshot()
+     * @param user_state Receives the user state passed to snapshot()
+     * @return false if <path> does not exist
+     * @throws std::runtime_error if the file is corrupt or does not match the tracked tensors
+     */
+    bool restore(int64_t *step = nullptr, std::string *user_state = nullptr);
+
+private:
+    struct Entry {
+        std::string name;
+        Tensor *tensor;
+        boost::intrusive_ptr<Tensor> keep;
+    };
+    // Staging copy of every tracked tensor, counted as Workspace memory.
+    struct Staged {
+        std::vector<float32> data;
+        int64_t step = 0;
+        std::string user_state;
+
+        explicit Staged(size_t floats);
+        ~Staged();
+    };
+
+    std::string path;
+    std::vector<Entry> entries;
+    size_t total_floats = 0;
+    bool started = false;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::unique_ptr<Staged> pending;  // ready, waiting for the writer
+    std::unique_ptr<Staged> spare;    // free for the next snapshot()
+    bool writing = false;
+    bool stopping = false;
+    SnapshotStats counters;
+    std::atomic<size_t> progress{0};
+    std::thread writer;
+
+    void writer_loop();
+    void write_file(const Staged &staged);
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <value.h>
+
+/**
+ * @brief Immutable sparse matrix in compressed sparse row (CSR) form.
+ *
+ * Used as a constant left operand (e.g. a batch of high-dimensional sparse
+ * inputs); it takes no gradient itself.
+ */
+class SparseTensor {
+public:
+    int rows = 0, cols = 0;
+    std::vector<int> row_ptr;  // rows + 1 offsets into col_idx / values
+    std::vector<int> col_idx;
+    std::vector<float32> values;
+
+    SparseTensor() = default;
+    SparseTensor(int rows, int cols) : rows(rows), cols(cols), row_ptr(rows + 1, 0) {}
+
+    // Keep entries whose magnitude exceeds `threshold`.
+    static SparseTensor fromDense(const Tensor &t, float32 threshold = 0.0f);
+
+    /**
+     * @brief Build from coordinate (COO) triplets in any order; duplicates are summed
+     * @throws std::invalid_argument on mismatched lengths or out-of-range indices
+     */
+    static SparseTensor fromCOO(int rows, int cols, const std::vector<int> &row_ids,
+                                const std::vector<int> &col_ids, const std::vector<float32> &vals);
+
+    size_t nnz() const { return values.size(); }
+
+    SparseTensor transpose() const;
+
+    /**
+     * @brief A^T and its non-empty row ids, built on first use and then
+     * reused, so repeated backward passes over the same matrix cost
+     * O(nnz) instead of O(cols + nnz). Thread-safe; do not modify the
+     * matrix after the first call.
+     */
+    const SparseTensor &transposed() const;
+    const std::vector<int> &nonEmptyTransposedRows() const;
+
+    /**
+     * @brief Split rows into at most `parts` contiguous blocks of roughly
+     * equal nnz. Returns block boundaries, from 0 to rows.
+     */
+    std::vector<int> balancedRowBlocks(int parts) const;
+
+private:
+    // Copies start with an empty cache, so a copied-then-edited matrix
+    // never sees a stale transpose.
+    struct TransposeCache {
+        std::once_flag built;
+        std::shared_ptr<const SparseTensor> transposed;
+        std::vector<int> non_empty;
+
+        TransposeCache() = default;
+        TransposeCache(const TransposeCache &) {}
+        TransposeCache &operator=(const TransposeCache &) { return *this; }
+    };
+    mutable TransposeCache cache;
+
+    void buildTransposeCache() const;
+};
+
+/**
+ * @brief Sparse x dense product A * W as a graph node.
+ *
+ * Forward splits work across threads in nnz-balanced row blocks. Backward
+ * visits only the non-empty rows of A^T, cached on A after the first pass,
+ * so each step costs O(nnz) whatever the width d of A. The gradient of W is
+ * row-sparse: only rows matching a non-empty column of A are written, and
+ * they are recorded in W's touched_rows so Value::update_rows() can skip
+ * the rest.
+ *
+ * @param A Sparse left operand (n x d), shared with the graph until backward
+ * @param W Dense right operand (d x h)
+ * @return Dense n x h result
+ */
+Value spmm(std::shared_ptr<const SparseTensor> A, const Value &W);
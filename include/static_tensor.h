@@ -0,0 +1,279 @@
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <memory_stats.h>
+#include <profiler.h>
+#include <value.h>
+
+/**
+ * @brief Fixed-shape matrix with inline storage for tiny operands.
+ *
+ * Shapes are template parameters, so every loop has constant bounds the
+ * compiler can fully unroll and vectorise, nothing touches the heap, and a
+ * shape mismatch in operator* is a compile error rather than an exception.
+ *
+ * StaticTensor carries no gradient of its own. Mixed with a Value it takes
+ * part in the autograd graph directly: Value * StaticTensor, StaticTensor *
+ * Value, and + / - in either order record a graph node whose backward sends
+ * the gradient to the Value operand. The static operand is a constant, like
+ * an mse() target. toValue() (a leaf Value holding a copy) and from() (a
+ * copy of a trained Value) convert between the two when the static side
+ * needs a gradient, e.g. train with Value and serve with StaticTensor.
+ */
+template <int R, int C>
+struct StaticTensor {
+    static_assert(R > 0 && C > 0, "StaticTensor dimensions must be positive");
+    static constexpr int rows = R;
+    static constexpr int cols = C;
+
+    alignas(32) float32 data[R][C] = {};
+
+    float32 *operator[](int i) { return data[i]; }
+    const float32 *operator[](int i) const { return data[i]; }
+
+    /**
+     * @brief Copy a runtime-shaped tensor
+     * @throws std::invalid_argument if the shape is not R x C
+     */
+    static StaticTensor from(const Tensor &t) {
+        if (t.rows != R || t.cols != C) {
+            throw std::invalid_argument("Tensor shape " + std::to_string(t.rows) + "x" + std::to_string(t.cols) +
+                                        " does not match StaticTensor " + std::to_string(R) + "x" + std::to_string(C));
+        }
+        StaticTensor s;
+        for (int i = 0; i < R; i++) {
+            for (int j = 0; j < C; j++) {
+                s.data[i][j] = t.data[i][j];
+            }
+        }
+        return s;
+    }
+
+    static StaticTensor from(const Value &v) {
+        return from(v.orig ? *v.orig : *v.ptr);
+    }
+
+    // New leaf Value holding a copy, ready to join an autograd graph.
+    Value toValue(const std::string &name = "", MemCategory category = MemCategory::Activation) const {
+        float32 *row_ptrs[R];
+        for (int i = 0; i < R; i++) {
+            row_ptrs[i] = const_cast<float32 *>(data[i]);
+        }
+        return Value(R, C, row_ptrs, name, category);
+    }
+
+    // Same summation order as Tensor::operator*, so results match it bit for bit.
+    template <int K>
+    StaticTensor<R, K> operator*(const StaticTensor<C, K> &t) const {
+        StaticTensor<R, K> result;
+        for (int i = 0; i < R; i++) {
+            for (int k = 0; k < C; k++) {
+                const float32 a = data[i][k];
+                for (int j = 0; j < K; j++) {
+                    result.data[i][j] += a * t.data[k][j];
+                }
+            }
+        }
+        return result;
+    }
+
+    StaticTensor operator+(const StaticTensor &t) const {
+        StaticTensor result;
+        for (int i = 0; i < R; i++) {
+            for (int j = 0; j < C; j++) {
+                result.data[i][j] = data[i][j] + t.data[i][j];
+            }
+        }
+        return result;
+    }
+
+    StaticTensor operator-(const StaticTensor &t) const {
+        StaticTensor result;
+        for (int i = 0; i < R; i++) {
+            for (int j = 0; j < C; j++) {
+                result.data[i][j] = data[i][j] - t.data[i][j];
+            }
+        }
+        return result;
+    }
+
+    StaticTensor leakyrelu(float leaky = 0.01f) const {
+        StaticTensor result;
+        for (int i = 0; i < R; i++) {
+            for (int j = 0; j < C; j++) {
+                result.data[i][j] = data[i][j] > 0 ? data[i][j] : leaky * data[i][j];
+            }
+        }
+        return result;
+    }
+};
+
+namespace static_detail {
+
+inline void check_shape(const Tensor &t, int rows, int cols, const char *op) {
+    if (t.rows != rows || t.cols != cols) {
+        throw std::invalid_argument(std::string(op) + ": Value shape " + std::to_string(t.rows) + "x" +
+                                    std::to_string(t.cols) + " does not match " + std::to_string(rows) + "x" +
+                                    std::to_string(cols));
+    }
+}
+
+// Leaf of a Value operand, following the orig-if-finished rule of Value's ops.
+inline Tensor *operand(const Value &v) {
+    if (v.ptr->_backward == nullptr && v.orig) {
+        v.ptr = v.orig;
+    }
+    return v.ptr.get();
+}
+
+// Row pointers into a StaticTensor, so the shared GEMM kernels (and with
+// them the summation order of the dynamic path) apply unchanged.
+template <int R, int C>
+struct Rows {
+    const float32 *p[R];
+
+    explicit Rows(const StaticTensor<R, C> &s) {
+        for (int i = 0; i < R; i++) {
+            p[i] = s.data[i];
+        }
+    }
+};
+
+// Backward of Value * StaticTensor (static_on_right) or StaticTensor * Value.
+// The static operand is kept by value so it outlives the caller's copy.
+template <int R, int C>
+struct MatmulContext : OpContext {
+    StaticTensor<R, C> constant;
+    bool static_on_right;
+
+    MatmulContext(const StaticTensor<R, C> &constant, bool static_on_right)
+        : constant(constant), static_on_right(static_on_right) {}
+
+    void backward(Tensor &node) override {
+        Tensor *in = node.left.get();
+        ProfileScope prof("backstatic_matmul", 2.0 * node.rows * node.cols * (static_on_right ? C : R),
+                          sizeof(float32) * (1.0 * node.rows * node.cols + 2.0 * in->rows * in->cols + R * C));
+        prof.shapes(node.rows, node.cols, in->rows, in->cols, R, C);
+        Rows<R, C> w(constant);
+        if (static_on_right) {
+            // d(in) = dOut * W^T, as backmul computes it for the left operand
+            gemm_nt(node.grad, w.p, in->grad, node.rows, node.cols, R);
+        } else {
+            // d(in) = S^T * dOut, as backmul computes it for the right operand
+            gemm_tn(w.p, node.grad, in->grad, C, node.rows, node.cols);
+        }
+        clip_gradient(in->grad, in->rows, in->cols);
+    }
+};
+
+// Backward of Value +/- StaticTensor: the Value operand gets sign * dOut.
+struct ElementwiseContext : OpContext {
+    float sign;
+
+    explicit ElementwiseContext(float sign) : sign(sign) {}
+
+    void backward(Tensor &node) override {
+        Tensor *in = node.left.get();
+        ProfileScope prof("backstatic_elementwise", 1.0 * node.rows * node.cols,
+                          3.0 * sizeof(float32) * node.rows * node.cols);
+        prof.shapes(node.rows, node.cols, in->rows, in->cols);
+        for (int i = 0; i < node.rows; i++) {
+            for (int j = 0; j < node.cols; j++) {
+                in->grad[i][j] += sign * node.grad[i][j];
+            }
+        }
+        clip_gradient(in->grad, in->rows, in->cols);
+    }
+};
+
+template <int R, int C>
+Value elementwise(const Value &v, const StaticTensor<R, C> &s, float value_sign, float static_sign,
+                  const char *op, bool static_first) {
+    Tensor *in = operand(v);
+    check_shape(*in, R, C, op);
+    AllocSiteScope site("static_elementwise");
+    ProfileScope prof("static_elementwise", 1.0 * R * C, 3.0 * sizeof(float32) * R * C);
+    prof.shapes(R, C, R, C, R, C);
+    Tensor *result = new Tensor(R, C);
+    Value out(result);
+    result->link(in);
+    result->name = static_first ? "static" + std::string(op) + in->name : in->name + op + "static";
+    for (int i = 0; i < R; i++) {
+        for (int j = 0; j < C; j++) {
+            result->data[i][j] = value_sign * in->data[i][j] + static_sign * s.data[i][j];
+        }
+    }
+    result->ctx = std::make_shared<ElementwiseContext>(value_sign);
+    result->_backward = &Tensor::backcontext;
+    return out;
+}
+
+}  // namespace static_detail
+
+/**
+ * @brief Graph node for v * w with a constant fixed-shape right operand
+ * @throws std::invalid_argument if v does not have C columns
+ */
+template <int C, int K>
+Value operator*(const Value &v, const StaticTensor<C, K> &w) {
+    Tensor *in = static_detail::operand(v);
+    static_detail::check_shape(*in, in->rows, C, "Value * StaticTensor");
+    AllocSiteScope site("static_matmul");
+    ProfileScope prof("static_matmul", 2.0 * in->rows * C * K,
+                      sizeof(float32) * (1.0 * in->rows * C + 1.0 * C * K + 1.0 * in->rows * K));
+    prof.shapes(in->rows, K, in->rows, C, C, K);
+    Tensor *result = new Tensor(in->rows, K);
+    Value out(result);
+    result->link(in);
+    result->name = in->name + "*static";
+    static_detail::Rows<C, K> rows(w);
+    gemm_nn(in->data, rows.p, result->data, in->rows, C, K);
+    result->ctx = std::make_shared<static_detail::MatmulContext<C, K>>(w, true);
+    result->_backward = &Tensor::backcontext;
+    return out;
+}
+
+/**
+ * @brief Graph node for s * v with a constant fixed-shape left operand
+ * @throws std::invalid_argument if v does not have C rows
+ */
+template <int R, int C>
+Value operator*(const StaticTensor<R, C> &s, const Value &v) {
+    Tensor *in = static_detail::operand(v);
+    static_detail::check_shape(*in, C, in->cols, "StaticTensor * Value");
+    AllocSiteScope site("static_matmul");
+    ProfileScope prof("static_matmul", 2.0 * R * C * in->cols,
+                      sizeof(float32) * (1.0 * R * C + 1.0 * C * in->cols + 1.0 * R * in->cols));
+    prof.shapes(R, in->cols, R, C, C, in->cols);
+    Tensor *result = new Tensor(R, in->cols);
+    Value out(result);
+    result->link(in);
+    result->name = "static*" + in->name;
+    static_detail::Rows<R, C> rows(s);
+    gemm_nn(rows.p, in->data, result->data, R, C, in->cols);
+    result->ctx = std::make_shared<static_detail::MatmulContext<R, C>>(s, false);
+    result->_backward = &Tensor::backcontext;
+    return out;
+}
+
+template <int R, int C>
+Value operator+(const Value &v, const StaticTensor<R, C> &s) {
+    return static_detail::elementwise(v, s, 1.0f, 1.0f, "+", false);
+}
+
+template <int R, int C>
+Value operator+(const StaticTensor<R, C> &s, const Value &v) {
+    return static_detail::elementwise(v, s, 1.0f, 1.0f, "+", true);
+}
+
+template <int R, int C>
+Value operator-(const Value &v, const StaticTensor<R, C> &s) {
+    return static_detail::elementwise(v, s, 1.0f, -1.0f, "-", false);
+}
+
+template <int R, int C>
+Value operator-(const StaticTensor<R, C> &s, const Value &v) {
+    return static_detail::elementwise(v, s, -1.0f, 1.0f, "-", true);
+}
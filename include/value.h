@@ -29,12 +29,15 @@ public:
         ptr = t;
     }
 
-    Value(int row, int cols, float **data, std::string name)
+    Value(int row, int cols, float **data, std::string name,
+          MemCategory category = MemCategory::Parameter)
     {
-        ptr = boost::intrusive_ptr<Tensor>(new Tensor(row, cols, data, name));
+        ptr = boost::intrusive_ptr<Tensor>(new Tensor(row, cols, data, name, category));
         orig = ptr;
     }
 
+    Value(const Value &other) = default;
+
     Value &operator=(const Value &other)
     {
         if (this != &other)
@@ -95,6 +98,42 @@ public:
         }
         return Value(new Tensor(ptr->lekyrelu(leaky)));
     }
+    Value sum(int axis = -1) const
+    {
+        if (ptr->_backward == nullptr && orig != nullptr)
+        {
+            this->ptr = this->orig;
+        }
+        return Value(new Tensor(ptr->sum(axis)));
+    }
+    Value mean(int axis = -1) const
+    {
+        if (ptr->_backward == nullptr && orig != nullptr)
+        {
+            this->ptr = this->orig;
+        }
+        return Value(new Tensor(ptr->mean(axis)));
+    }
+    Value mse(const Value &target) const
+    {
+        if (ptr->_backward == nullptr && orig != nullptr)
+        {
+            this->ptr = this->orig;
+        }
+        return Value(new Tensor(ptr->mse(*target.ptr)));
+    }
+    Value cross_entropy(const Value &target) const
+    {
+        if (ptr->_backward == nullptr && orig != nullptr)
+        {
+            this->ptr = this->orig;
+        }
+        return Value(new Tensor(ptr->cross_entropy(*target.ptr)));
+    }
+    float item() const
+    {
+        return ptr->data[0][0];
+    }
     void setgrad(float **grad)
     {
         ptr->setGrad(grad);
@@ -108,6 +147,10 @@ public:
     {
         ptr->backward();
     }
+    void backward(float seed)
+    {
+        ptr->backward(seed);
+    }
 
     void printgrad()
     {
@@ -167,4 +210,9 @@ public:
         this->ptr = this->orig;
         orig->update(learning_rate);
     }
+    void update_rows(float learning_rate)
+    {
+        this->ptr = this->orig;
+        orig->update_rows(learning_rate);
+    }
 };
\ No newline at end of file
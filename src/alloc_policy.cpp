@@ -0,0 +1,233 @@
+#include "alloc_policy.h"
+#include "parallel.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <iomanip>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// From <numaif.h>; called through syscall() so libnuma is not needed.
+constexpr int MPOL_BIND_MODE = 2;
+constexpr int MPOL_INTERLEAVE_MODE = 3;
+constexpr size_t HUGE_PAGE = 2 << 20;
+constexpr size_t SMALL_ALIGN = 64;
+constexpr size_t PAGE = 4096;
+
+struct State {
+    // Published copy-on-write: configure() swaps in a new config and never
+    // frees the old one, so alloc_block() reads it with one atomic load.
+    std::atomic<const AllocConfig*> config{nullptr};
+    std::atomic<size_t> large_blocks{0};
+    std::atomic<size_t> large_bytes{0};
+    std::atomic<size_t> huge_bytes{0};
+    std::atomic<size_t> fallbacks{0};
+};
+
+AllocConfig from_env() {
+    AllocConfig c;
+    if (const char* numa = std::getenv("ESP_NUMA")) {
+        std::string v(numa);
+        if (v == "first-touch") {
+            c.numa = NumaPolicy::FirstTouch;
+        } else if (v == "interleave") {
+            c.numa = NumaPolicy::Interleave;
+        } else if (v.compare(0, 4, "bind") == 0) {
+            c.numa = NumaPolicy::Bind;
+            c.bind_node = v.size() > 5 ? std::atoi(v.c_str() + 5) : 0;
+        }
+    }
+    if (const char* threshold = std::getenv("ESP_HUGEPAGE_THRESHOLD")) {
+        c.large_threshold = std::strtoull(threshold, nullptr, 10);
+    }
+    if (const char* huge = std::getenv("ESP_HUGEPAGES")) {
+        c.huge_pages = std::strcmp(huge, "0") != 0;
+    }
+    return c;
+}
+
+State& state() {
+    static State* s = [] {
+        State* st = new State();
+        st->config.store(new AllocConfig(from_env()), std::memory_order_release);
+        return st;
+    }();
+    return *s;
+}
+
+size_t round_up(size_t v, size_t a) {
+    return (v + a - 1) / a * a;
+}
+
+bool place(void* addr, size_t len, const AllocConfig& c) {
+    unsigned long mask = 0;
+    int mode;
+    if (c.numa == NumaPolicy::Interleave) {
+        int nodes = AllocPolicy::numaNodes();
+        mask = nodes >= 64 ? ~0UL : (1UL << nodes) - 1;
+        mode = MPOL_INTERLEAVE_MODE;
+    } else {
+        if (c.bind_node < 0 || c.bind_node >= 64) {
+            return false;
+        }
+        mask = 1UL << c.bind_node;
+        mode = MPOL_BIND_MODE;
+    }
+    return syscall(SYS_mbind, addr, len, mode, &mask, sizeof(mask) * 8 + 1, 0) == 0;
+}
+
+// Write one float per page from the pool, so each page is faulted in by
+// the worker whose chunk covers it. `page` is the huge-page size when the
+// block was advised, so chunks never split a 2 MB page between workers.
+void first_touch(float* data, size_t len, size_t page) {
+    int pages = static_cast<int>(len / page);
+    int min_chunk = page == PAGE ? 64 : 1;
+    parallel_for(0, pages, min_chunk, [&](int begin, int end) {
+        for (int p = begin; p < end; p++) {
+            data[p * (page / sizeof(float))] = 0.0f;
+        }
+    });
+}
+
+MemBlock map_large(size_t bytes, const AllocConfig& c) {
+    State& s = state();
+    size_t len = round_up(bytes, HUGE_PAGE);
+    // Over-map by one huge page and trim, so the block starts 2 MB aligned.
+    void* raw = mmap(nullptr, len + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    char* base = static_cast<char*>(raw);
+    char* aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<size_t>(base), HUGE_PAGE));
+    if (aligned > base) {
+        munmap(base, aligned - base);
+    }
+    size_t tail = (base + len + HUGE_PAGE) - (aligned + len);
+    if (tail > 0) {
+        munmap(aligned + len, tail);
+    }
+
+    bool huge = false;
+    if (c.huge_pages) {
+        if (madvise(aligned, len, MADV_HUGEPAGE) == 0) {
+            huge = true;
+            s.huge_bytes.fetch_add(len, std::memory_order_relaxed);
+        } else {
+            s.fallbacks.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (c.numa == NumaPolicy::Interleave || c.numa == NumaPolicy::Bind) {
+        if (!place(aligned, len, c)) {
+            s.fallbacks.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (c.numa == NumaPolicy::FirstTouch) {
+        first_touch(reinterpret_cast<float*>(aligned), len, huge ? HUGE_PAGE : PAGE);
+    }
+    s.large_blocks.fetch_add(1, std::memory_order_relaxed);
+    s.large_bytes.fetch_add(len, std::memory_order_relaxed);
+
+    MemBlock block;
+    block.data = reinterpret_cast<float*>(aligned);
+    block.bytes = len;
+    block.mapped = true;
+    return block;
+}
+
+}  // namespace
+
+const char* numa_policy_name(NumaPolicy policy) {
+    switch (policy) {
+        case NumaPolicy::Default: return "default";
+        case NumaPolicy::FirstTouch: return "first-touch";
+        case NumaPolicy::Interleave: return "interleave";
+        case NumaPolicy::Bind: return "bind";
+        default: return "unknown";
+    }
+}
+
+AllocConfig AllocPolicy::config() {
+    return *state().config.load(std::memory_order_acquire);
+}
+
+void AllocPolicy::configure(const AllocConfig& config) {
+    // Readers may still hold the previous config; it is leaked on purpose.
+    state().config.store(new AllocConfig(config), std::memory_order_release);
+}
+
+int AllocPolicy::numaNodes() {
+    static const int nodes = [] {
+        int n = 0;
+        if (DIR* dir = opendir("/sys/devices/system/node")) {
+            while (dirent* e = readdir(dir)) {
+                if (std::strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9') {
+                    n++;
+                }
+            }
+            closedir(dir);
+        }
+        return n > 0 ? n : 1;
+    }();
+    return nodes;
+}
+
+size_t AllocPolicy::largeBlocks() {
+    return state().large_blocks.load(std::memory_order_relaxed);
+}
+
+size_t AllocPolicy::largeBytes() {
+    return state().large_bytes.load(std::memory_order_relaxed);
+}
+
+size_t AllocPolicy::hugePageBytes() {
+    return state().huge_bytes.load(std::memory_order_relaxed);
+}
+
+size_t AllocPolicy::fallbacks() {
+    return state().fallbacks.load(std::memory_order_relaxed);
+}
+
+void AllocPolicy::report(std::ostream& os) {
+    AllocConfig c = config();
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(1);
+    os << "Allocation policy: numa=" << numa_policy_name(c.numa);
+    if (c.numa == NumaPolicy::Bind) {
+        os << ":" << c.bind_node;
+    }
+    os << " nodes=" << numaNodes() << " large>=" << c.large_threshold / 1024.0 << " KB"
+       << " huge_pages=" << (c.huge_pages ? "on" : "off") << " pinned=" << (pin_threads() ? "on" : "off") << "\n";
+    os << "  large blocks " << largeBlocks() << " (" << largeBytes() / 1024.0 << " KB), huge-page advised "
+       << hugePageBytes() / 1024.0 << " KB, placement fallbacks " << fallbacks() << std::endl;
+    os.unsetf(std::ios::fixed);
+    os.precision(precision);
+}
+
+MemBlock alloc_block(size_t bytes) {
+    const AllocConfig& c = *state().config.load(std::memory_order_acquire);
+    if (c.large_threshold > 0 && bytes >= c.large_threshold) {
+        return map_large(bytes, c);
+    }
+    MemBlock block;
+    block.bytes = round_up(bytes > 0 ? bytes : 1, SMALL_ALIGN);
+    block.data = static_cast<float*>(std::aligned_alloc(SMALL_ALIGN, block.bytes));
+    if (!block.data) {
+        throw std::bad_alloc();
+    }
+    std::memset(block.data, 0, block.bytes);
+    return block;
+}
+
+void free_block(const MemBlock& block) {
+    if (block.mapped) {
+        munmap(block.data, block.bytes);
+    } else {
+        std::free(block.data);
+    }
+}
@@ -0,0 +1,60 @@
+#include "checkpoint.h"
+#include "memory_stats.h"
+#include "profiler.h"
+
+namespace {
+
+struct CheckpointContext : OpContext {
+    Segment segment;
+
+    explicit CheckpointContext(const Segment &segment) : segment(segment) {}
+
+    void backward(Tensor &node) override {
+        ProfileScope prof("backcheckpoint");
+        prof.shapes(node.rows, node.cols, node.left->rows, node.left->cols);
+
+        // The replay input shares storage with the real input, so gradients
+        // flowing out of the segment accumulate straight into it.
+        Value replay_in(node.left->alias());
+        Value replay_out;
+        {
+            AllocSiteScope site("checkpoint_replay");
+            replay_out = segment(replay_in);
+        }
+        Tensor &out = *replay_out.ptr;
+        for (int i = 0; i < node.rows; i++) {
+            memcpy(out.grad[i], node.grad[i], node.cols * sizeof(float32));
+        }
+        out.propagate();
+    }
+};
+
+}  // namespace
+
+Value checkpoint(const Segment &segment, const Value &input, bool enabled)
+{
+    if (!enabled)
+    {
+        return segment(input);
+    }
+    if (input.ptr->_backward == nullptr && input.orig != nullptr)
+    {
+        input.ptr = input.orig;
+    }
+    Tensor *in = input.ptr.get();
+
+    Value out;
+    {
+        // Run on an alias so the segment's graph ends at the alias and is
+        // dropped together with `out`.
+        AllocSiteScope site("checkpoint");
+        out = segment(Value(in->alias()));
+    }
+
+    AllocSiteScope site("checkpoint");
+    Tensor *result = new Tensor(out.ptr->rows, out.ptr->cols, out.ptr->data, "checkpoint(" + out.ptr->name + ")");
+    result->link(in);
+    result->ctx = std::make_shared<CheckpointContext>(segment);
+    result->_backward = &Tensor::backcontext;
+    return Value(result);
+}
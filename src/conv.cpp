@@ -0,0 +1,194 @@
+#include "conv.h"
+#include "memory_stats.h"
+#include "profiler.h"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+bool is_pointwise(const ConvSpec &s) {
+    return s.kernel_h == 1 && s.kernel_w == 1 && s.stride_h == 1 && s.stride_w == 1 && s.pad_h == 0 &&
+           s.pad_w == 0;
+}
+
+// Unrolled patches of one sample, one row per output position. Rows point
+// into `buffer`, or straight into the sample for pointwise kernels.
+class Patches {
+private:
+    const ConvSpec &spec;
+    std::vector<float32> buffer;
+    std::vector<float32 *> row_ptrs;
+
+public:
+    explicit Patches(const ConvSpec &spec)
+        : spec(spec), row_ptrs(static_cast<size_t>(spec.out_h()) * spec.out_w()) {
+        if (!is_pointwise(spec)) {
+            buffer.resize(row_ptrs.size() * spec.patch());
+            for (size_t p = 0; p < row_ptrs.size(); p++) {
+                row_ptrs[p] = buffer.data() + p * spec.patch();
+            }
+            MemoryStats::allocate(MemCategory::Workspace, "conv2d", buffer.size() * sizeof(float32));
+        }
+    }
+
+    ~Patches() {
+        if (!buffer.empty()) {
+            MemoryStats::release(MemCategory::Workspace, "conv2d", buffer.size() * sizeof(float32));
+        }
+    }
+
+    float32 **rows() { return row_ptrs.data(); }
+
+    void im2col(float32 *sample) {
+        const int C = spec.channels;
+        if (is_pointwise(spec)) {
+            for (size_t p = 0; p < row_ptrs.size(); p++) {
+                row_ptrs[p] = sample + p * C;
+            }
+            return;
+        }
+        const int OW = spec.out_w();
+        for (int oh = 0; oh < spec.out_h(); oh++) {
+            for (int ow = 0; ow < OW; ow++) {
+                float32 *dst = row_ptrs[oh * OW + ow];
+                for (int kh = 0; kh < spec.kernel_h; kh++) {
+                    const int ih = oh * spec.stride_h - spec.pad_h + kh * spec.dilation_h;
+                    for (int kw = 0; kw < spec.kernel_w; kw++, dst += C) {
+                        const int iw = ow * spec.stride_w - spec.pad_w + kw * spec.dilation_w;
+                        if (ih < 0 || ih >= spec.height || iw < 0 || iw >= spec.width) {
+                            std::memset(dst, 0, C * sizeof(float32));
+                        } else {
+                            std::memcpy(dst, sample + (ih * spec.width + iw) * C, C * sizeof(float32));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Add every patch row back onto the sample positions it was read from.
+    void col2im(float32 *sample) {
+        const int C = spec.channels;
+        const int OW = spec.out_w();
+        for (int oh = 0; oh < spec.out_h(); oh++) {
+            for (int ow = 0; ow < OW; ow++) {
+                const float32 *src = row_ptrs[oh * OW + ow];
+                for (int kh = 0; kh < spec.kernel_h; kh++) {
+                    const int ih = oh * spec.stride_h - spec.pad_h + kh * spec.dilation_h;
+                    for (int kw = 0; kw < spec.kernel_w; kw++, src += C) {
+                        const int iw = ow * spec.stride_w - spec.pad_w + kw * spec.dilation_w;
+                        if (ih < 0 || ih >= spec.height || iw < 0 || iw >= spec.width) {
+                            continue;
+                        }
+                        float32 *dst = sample + (ih * spec.width + iw) * C;
+                        for (int c = 0; c < C; c++) {
+                            dst[c] += src[c];
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+// Rows of one output sample, one per output position, each F wide.
+std::vector<float32 *> position_rows(float32 *sample, int positions, int filters) {
+    std::vector<float32 *> rows(positions);
+    for (int p = 0; p < positions; p++) {
+        rows[p] = sample + static_cast<size_t>(p) * filters;
+    }
+    return rows;
+}
+
+struct ConvContext : OpContext {
+    ConvSpec spec;
+
+    explicit ConvContext(const ConvSpec &spec) : spec(spec) {}
+
+    void backward(Tensor &node) override {
+        Tensor *input = node.left.get();
+        Tensor *weight = node.right.get();
+        const int P = spec.out_h() * spec.out_w();
+        const int K = spec.patch();
+        const int F = weight->cols;
+        ProfileScope prof("backconv2d", 4.0 * input->rows * P * K * F,
+                          sizeof(float32) * (2.0 * input->rows * input->cols + 2.0 * K * F + 1.0 * node.rows * node.cols));
+        prof.shapes(node.rows, node.cols, input->rows, input->cols, weight->rows, weight->cols);
+
+        Patches patches(spec);
+        Patches dpatches(spec);
+        for (int n = 0; n < input->rows; n++) {
+            std::vector<float32 *> dout = position_rows(node.grad[n], P, F);
+            patches.im2col(input->data[n]);
+            gemm_tn(patches.rows(), dout.data(), weight->grad, K, P, F);
+
+            if (is_pointwise(spec)) {
+                // Patch rows are the input grad rows themselves.
+                dpatches.im2col(input->grad[n]);
+                gemm_nt(dout.data(), weight->data, dpatches.rows(), P, F, K);
+            } else {
+                std::memset(dpatches.rows()[0], 0, sizeof(float32) * P * K);
+                gemm_nt(dout.data(), weight->data, dpatches.rows(), P, F, K);
+                dpatches.col2im(input->grad[n]);
+            }
+        }
+        clip_gradient(input->grad, input->rows, input->cols);
+        clip_gradient(weight->grad, weight->rows, weight->cols);
+    }
+};
+
+void check_shapes(const Tensor &input, const Tensor &weight, const ConvSpec &s) {
+    if (s.channels < 1 || s.kernel_h < 1 || s.kernel_w < 1 || s.stride_h < 1 || s.stride_w < 1 ||
+        s.dilation_h < 1 || s.dilation_w < 1 || s.pad_h < 0 || s.pad_w < 0) {
+        throw std::invalid_argument("Invalid convolution spec");
+    }
+    if (s.out_h() < 1 || s.out_w() < 1) {
+        throw std::invalid_argument("Convolution kernel does not fit the padded input");
+    }
+    if (input.cols != s.height * s.width * s.channels) {
+        throw std::invalid_argument("Convolution input has " + std::to_string(input.cols) + " columns, spec expects " +
+                                    std::to_string(s.height * s.width * s.channels));
+    }
+    if (weight.rows != s.patch()) {
+        throw std::invalid_argument("Convolution weight has " + std::to_string(weight.rows) + " rows, spec expects " +
+                                    std::to_string(s.patch()));
+    }
+}
+
+}  // namespace
+
+Value conv2d(const Value &input, const Value &weight, const ConvSpec &spec) {
+    if (input.ptr->_backward == nullptr && input.orig != nullptr) {
+        input.ptr = input.orig;
+    }
+    if (weight.ptr->_backward == nullptr && weight.orig != nullptr) {
+        weight.ptr = weight.orig;
+    }
+    Tensor *in = input.ptr.get();
+    Tensor *w = weight.ptr.get();
+    check_shapes(*in, *w, spec);
+
+    const int P = spec.out_h() * spec.out_w();
+    const int K = spec.patch();
+    const int F = w->cols;
+    AllocSiteScope site("conv2d");
+    ProfileScope prof("conv2d", 2.0 * in->rows * P * K * F,
+                      sizeof(float32) * (1.0 * in->rows * in->cols + 1.0 * K * F + 1.0 * in->rows * P * F));
+    prof.shapes(in->rows, P * F, in->rows, in->cols, w->rows, w->cols);
+
+    Tensor *result = new Tensor(in->rows, P * F);
+    Value out(result);
+    result->link(in, w);
+    result->name = "conv(" + in->name + "," + w->name + ")";
+
+    Patches patches(spec);
+    for (int n = 0; n < in->rows; n++) {
+        std::vector<float32 *> rows = position_rows(result->data[n], P, F);
+        patches.im2col(in->data[n]);
+        gemm_nn(patches.rows(), w->data, rows.data(), P, K, F);
+    }
+    result->ctx = std::make_shared<ConvContext>(spec);
+    result->_backward = &Tensor::backcontext;
+    return out;
+}
@@ -0,0 +1,449 @@
+#include "data_parallel.h"
+#include "memory_stats.h"
+#include "profiler.h"
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+static_assert(std::atomic<int>::is_always_lock_free, "shared-memory counters need lock-free atomics");
+static_assert(std::atomic<long>::is_always_lock_free, "shared-memory counters need lock-free atomics");
+
+namespace {
+
+struct ParamSlot {
+    Tensor *tensor;
+    size_t offset;  // in floats, within one worker's staging area
+    size_t count;
+    int bucket;
+};
+
+struct Bucket {
+    size_t begin;  // float range covered in the flat gradient layout
+    size_t end;
+    int params;
+};
+
+/**
+ * Layout of the shared segment:
+ *   header | arrived[buckets] | reduced[buckets] | published[world] |
+ *   losses[2][world] | staging[world][total] | result[total]
+ */
+struct SharedState {
+    std::atomic<int> aborted;
+};
+
+struct Layout {
+    size_t arrived;
+    size_t reduced;
+    size_t published;
+    size_t losses;
+    size_t staging;
+    size_t result;
+    size_t bytes;
+};
+
+size_t align_up(size_t v, size_t a) {
+    return (v + a - 1) / a * a;
+}
+
+Layout make_layout(int buckets, int world, size_t total) {
+    Layout l;
+    l.arrived = align_up(sizeof(SharedState), 64);
+    l.reduced = align_up(l.arrived + buckets * sizeof(std::atomic<int>), 64);
+    l.published = align_up(l.reduced + buckets * sizeof(std::atomic<int>), 64);
+    l.losses = align_up(l.published + world * sizeof(std::atomic<long>), 64);
+    l.staging = align_up(l.losses + 2 * world * sizeof(float), 64);
+    l.result = align_up(l.staging + world * total * sizeof(float), 64);
+    l.bytes = align_up(l.result + total * sizeof(float), 4096);
+    return l;
+}
+
+// Finds workers that died without setting `aborted`, e.g. killed by a
+// signal or the OOM killer. Rank 0 reaps its children without blocking;
+// the other ranks notice when rank 0 is gone and they are re-parented.
+class Liveness {
+private:
+    std::vector<pid_t> children;
+    std::vector<int> statuses;
+    std::vector<char> reaped;
+    pid_t parent;
+
+public:
+    explicit Liveness(pid_t parent) : parent(parent) {}
+
+    void add_child(pid_t pid) {
+        children.push_back(pid);
+        statuses.push_back(0);
+        reaped.push_back(0);
+    }
+
+    size_t child_count() const { return children.size(); }
+
+    // In a forked worker: siblings are not our children, only watch rank 0.
+    void forget_children() {
+        children.clear();
+        statuses.clear();
+        reaped.clear();
+    }
+
+    // Throws if a worker has exited abnormally.
+    void check() {
+        for (size_t c = 0; c < children.size(); c++) {
+            if (!reaped[c] && waitpid(children[c], &statuses[c], WNOHANG) == children[c]) {
+                reaped[c] = 1;
+            }
+            if (reaped[c] && !exited_cleanly(c)) {
+                throw std::runtime_error(describe(c));
+            }
+        }
+        if (children.empty() && getppid() != parent) {
+            throw std::runtime_error("data-parallel rank 0 exited");
+        }
+    }
+
+    // Blocks until every child has exited; returns the first failure, if any.
+    std::string reap_all() {
+        std::string error;
+        for (size_t c = 0; c < children.size(); c++) {
+            if (!reaped[c]) {
+                waitpid(children[c], &statuses[c], 0);
+                reaped[c] = 1;
+            }
+            if (error.empty() && !exited_cleanly(c)) {
+                error = describe(c);
+            }
+        }
+        return error;
+    }
+
+private:
+    bool exited_cleanly(size_t c) const {
+        return WIFEXITED(statuses[c]) && WEXITSTATUS(statuses[c]) == 0;
+    }
+
+    std::string describe(size_t c) const {
+        std::string what = "data-parallel worker " + std::to_string(c + 1) + " exited abnormally";
+        if (WIFSIGNALED(statuses[c])) {
+            what += " (signal " + std::to_string(WTERMSIG(statuses[c])) + ")";
+        } else if (WIFEXITED(statuses[c])) {
+            what += " (status " + std::to_string(WEXITSTATUS(statuses[c])) + ")";
+        }
+        return what;
+    }
+};
+
+class Worker {
+private:
+    char *base;
+    const Layout &layout;
+    const std::vector<ParamSlot> &slots;
+    const std::vector<Bucket> &buckets;
+    Liveness &liveness;
+    int rank;
+    int world;
+    size_t total;
+    int step = 0;
+    unsigned spins = 0;
+    std::vector<int> remaining;
+    std::vector<char> sent;
+
+    SharedState &shared() { return *reinterpret_cast<SharedState *>(base); }
+    std::atomic<int> &arrived(int b) { return reinterpret_cast<std::atomic<int> *>(base + layout.arrived)[b]; }
+    std::atomic<int> &reduced(int b) { return reinterpret_cast<std::atomic<int> *>(base + layout.reduced)[b]; }
+    // Steps whose loss rank r has written; a rank can be at most one step
+    // ahead of rank 0, so the two loss slots never get overwritten early.
+    std::atomic<long> &published(int r) { return reinterpret_cast<std::atomic<long> *>(base + layout.published)[r]; }
+    float *losses(int s) { return reinterpret_cast<float *>(base + layout.losses) + (s % 2) * world; }
+    float *staging(int r) { return reinterpret_cast<float *>(base + layout.staging) + r * total; }
+    float *result() { return reinterpret_cast<float *>(base + layout.result); }
+
+    // Called from every spin loop; checks for dead workers every 1024 spins.
+    void check_aborted() {
+        if (shared().aborted.load(std::memory_order_relaxed)) {
+            throw std::runtime_error("data-parallel worker aborted");
+        }
+        if (++spins % 1024 == 0) {
+            try {
+                liveness.check();
+            } catch (...) {
+                shared().aborted.store(1);
+                throw;
+            }
+        }
+    }
+
+    // Average one bucket across all workers' staging areas.
+    void reduce(int b) {
+        ProfileScope prof("allreduce_bucket", 1.0 * world * (buckets[b].end - buckets[b].begin),
+                          sizeof(float) * (world + 1.0) * (buckets[b].end - buckets[b].begin));
+        float scale = 1.0f / world;
+        float *out = result();
+        for (size_t i = buckets[b].begin; i < buckets[b].end; i++) {
+            float acc = 0.0f;
+            for (int r = 0; r < world; r++) {
+                acc += staging(r)[i];
+            }
+            out[i] = acc * scale;
+        }
+    }
+
+    void arrive(int b) {
+        if (arrived(b).fetch_add(1, std::memory_order_acq_rel) == world - 1) {
+            reduce(b);
+            arrived(b).store(0, std::memory_order_relaxed);
+            reduced(b).store(step + 1, std::memory_order_release);
+        }
+    }
+
+public:
+    Worker(char *base, const Layout &layout, const std::vector<ParamSlot> &slots,
+           const std::vector<Bucket> &buckets, Liveness &liveness, int rank, int world, size_t total)
+        : base(base), layout(layout), slots(slots), buckets(buckets), liveness(liveness), rank(rank),
+          world(world), total(total), remaining(buckets.size()), sent(slots.size()) {}
+
+    void begin_step(int s) {
+        step = s;
+        for (size_t b = 0; b < buckets.size(); b++) {
+            remaining[b] = buckets[b].params;
+        }
+        std::fill(sent.begin(), sent.end(), 0);
+    }
+
+    // Stage a finished parameter gradient; complete buckets are published.
+    void send(size_t p) {
+        if (sent[p]) {
+            return;
+        }
+        sent[p] = 1;
+        const ParamSlot &slot = slots[p];
+        float *dst = staging(rank) + slot.offset;
+        for (int i = 0; i < slot.tensor->rows; i++) {
+            memcpy(dst + i * slot.tensor->cols, slot.tensor->grad[i], slot.tensor->cols * sizeof(float));
+        }
+        if (--remaining[slot.bucket] == 0) {
+            arrive(slot.bucket);
+        }
+    }
+
+    // Publish this worker's loss and any parameter backward never reached.
+    void finish_step(float loss) {
+        losses(step)[rank] = loss;
+        published(rank).store(step + 1, std::memory_order_release);
+        for (size_t p = 0; p < slots.size(); p++) {
+            send(p);
+        }
+    }
+
+    void wait_reduced() {
+        for (size_t b = 0; b < buckets.size(); b++) {
+            while (reduced(b).load(std::memory_order_acquire) != step + 1) {
+                check_aborted();
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Parameter gradients were reduced unclipped; clip each average once,
+    // as a single process clips the full-batch gradient, then take the step.
+    void apply(float learning_rate) {
+        const float *avg = result();
+        for (const ParamSlot &slot : slots) {
+            Tensor *t = slot.tensor;
+            for (int i = 0; i < t->rows; i++) {
+                memcpy(t->grad[i], avg + slot.offset + i * t->cols, t->cols * sizeof(float));
+            }
+            clip_gradient(t->grad, t->rows, t->cols);
+            t->update(learning_rate);
+            t->setgradzero();
+        }
+    }
+
+    float mean_loss() {
+        for (int r = 0; r < world; r++) {
+            while (published(r).load(std::memory_order_acquire) < step + 1) {
+                check_aborted();
+                std::this_thread::yield();
+            }
+        }
+        float sum = 0.0f;
+        for (int r = 0; r < world; r++) {
+            sum += losses(step)[r];
+        }
+        return sum / world;
+    }
+};
+
+}  // namespace
+
+DataParallelTrainer::DataParallelTrainer(std::vector<Value *> params, DataParallelConfig config)
+    : params(std::move(params)), config(config) {
+    if (this->config.workers < 1) {
+        this->config.workers = 1;
+    }
+}
+
+std::vector<float> DataParallelTrainer::train(int steps, const StepFn &step,
+                                              const std::function<void(int, float)> &on_step) {
+    const int world = config.workers;
+
+    // Later layers finish backward first, so fill buckets from the back.
+    std::vector<ParamSlot> slots;
+    std::vector<Bucket> buckets;
+    size_t total = 0;
+    for (auto it = params.rbegin(); it != params.rend(); ++it) {
+        Value *v = *it;
+        Tensor *t = v->orig ? v->orig.get() : v->ptr.get();
+        size_t count = static_cast<size_t>(t->rows) * t->cols;
+        if (buckets.empty() || (buckets.back().end - buckets.back().begin) * sizeof(float) >= config.bucket_bytes) {
+            buckets.push_back(Bucket{total, total, 0});
+        }
+        slots.push_back(ParamSlot{t, total, count, static_cast<int>(buckets.size()) - 1});
+        total += count;
+        buckets.back().end = total;
+        buckets.back().params++;
+    }
+    std::unordered_map<const Tensor *, size_t> index;
+    for (size_t p = 0; p < slots.size(); p++) {
+        index[slots[p].tensor] = p;
+    }
+
+    Layout layout = make_layout(static_cast<int>(buckets.size()), world, total);
+    // One segment per train() call, so several trainers can share a process.
+    static std::atomic<int> segments{0};
+    std::string name = "/esp_dp_" + std::to_string(getpid()) + "_" + std::to_string(segments.fetch_add(1));
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("shm_open failed for " + name);
+    }
+    if (ftruncate(fd, layout.bytes) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("ftruncate failed for " + name);
+    }
+    void *mapped = mmap(nullptr, layout.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    // The mapping is inherited across fork, the name is no longer needed.
+    shm_unlink(name.c_str());
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("mmap failed for " + name);
+    }
+    char *base = static_cast<char *>(mapped);
+    new (base) SharedState{};
+    for (size_t b = 0; b < buckets.size(); b++) {
+        new (base + layout.arrived + b * sizeof(std::atomic<int>)) std::atomic<int>(0);
+        new (base + layout.reduced + b * sizeof(std::atomic<int>)) std::atomic<int>(0);
+    }
+    for (int r = 0; r < world; r++) {
+        new (base + layout.published + r * sizeof(std::atomic<long>)) std::atomic<long>(0);
+    }
+    MemoryStats::allocate(MemCategory::Workspace, "data_parallel", layout.bytes);
+
+    std::vector<float **> param_grads;
+    for (const ParamSlot &slot : slots) {
+        param_grads.push_back(slot.tensor->grad);
+    }
+
+    Liveness liveness(getpid());
+    auto run = [&](int rank, std::vector<float> *history) {
+        Worker worker(base, layout, slots, buckets, liveness, rank, world, total);
+        set_grad_ready_hook([&](Tensor &t) {
+            auto it = index.find(&t);
+            if (it != index.end()) {
+                worker.send(it->second);
+            }
+        });
+        for (int s = 0; s < steps; s++) {
+            worker.begin_step(s);
+            // Activation gradients are clipped per node as usual; parameter
+            // gradients are reduced unclipped and apply() clips the average.
+            set_deferred_clipping(param_grads);
+            float loss;
+            try {
+                loss = step(rank, world, s);
+            } catch (...) {
+                set_deferred_clipping({});
+                throw;
+            }
+            set_deferred_clipping({});
+            worker.finish_step(loss);
+            worker.wait_reduced();
+            worker.apply(config.learning_rate);
+            if (history) {
+                float mean = worker.mean_loss();
+                history->push_back(mean);
+                if (on_step) {
+                    on_step(s, mean);
+                }
+            }
+        }
+        set_grad_ready_hook(nullptr);
+    };
+
+    for (int rank = 1; rank < world; rank++) {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            // Each worker process owns one core; keep kernels single-threaded.
+            set_parallel_inline(true);
+            liveness.forget_children();
+            int status = 0;
+            try {
+                run(rank, nullptr);
+            } catch (const std::exception &e) {
+                std::cerr << "data-parallel worker " << rank << ": " << e.what() << std::endl;
+                reinterpret_cast<SharedState *>(base)->aborted.store(1);
+                status = 1;
+            }
+            std::cout.flush();
+            _exit(status);
+        }
+        if (pid < 0) {
+            reinterpret_cast<SharedState *>(base)->aborted.store(1);
+            break;
+        }
+        liveness.add_child(pid);
+    }
+
+    std::vector<float> history;
+    std::string error;
+    if (static_cast<int>(liveness.child_count()) == world - 1) {
+        // Like the other ranks, rank 0 owns one core while workers run.
+        set_thread_inline(world > 1);
+        try {
+            run(0, &history);
+        } catch (const std::exception &e) {
+            set_grad_ready_hook(nullptr);
+            reinterpret_cast<SharedState *>(base)->aborted.store(1);
+            error = e.what();
+        }
+        set_thread_inline(false);
+    } else {
+        error = "fork failed";
+    }
+
+    std::string child_error = liveness.reap_all();
+    if (error.empty() || error == "data-parallel worker aborted") {
+        error = child_error.empty() ? error : child_error;
+    }
+    munmap(mapped, layout.bytes);
+    MemoryStats::release(MemCategory::Workspace, "data_parallel", layout.bytes);
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    return history;
+}
+
+Value shard_rows(const Value &v, int rank, int world, MemCategory category) {
+    Tensor *t = v.orig ? v.orig.get() : v.ptr.get();
+    int begin = static_cast<int>(static_cast<long>(t->rows) * rank / world);
+    int end = static_cast<int>(static_cast<long>(t->rows) * (rank + 1) / world);
+    return Value(end - begin, t->cols, t->data + begin,
+                 t->name + "[" + std::to_string(rank) + "/" + std::to_string(world) + "]", category);
+}
@@ -0,0 +1,87 @@
+#include "embedding.h"
+#include "memory_stats.h"
+#include "parallel.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+struct EmbeddingContext : OpContext {
+    std::vector<int> ids;
+
+    explicit EmbeddingContext(std::vector<int> ids) : ids(std::move(ids)) {}
+
+    void backward(Tensor &node) override {
+        Tensor *table = node.left.get();
+        const int dim = table->cols;
+        const int n = static_cast<int>(ids.size());
+        ProfileScope prof("backembedding", 1.0 * n * dim, sizeof(float32) * 3.0 * n * dim);
+        prof.shapes(node.rows, node.cols, table->rows, table->cols);
+
+        // Output positions grouped by id, each group in position order so
+        // the sums do not depend on the thread count.
+        std::vector<int> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return ids[a] < ids[b]; });
+        std::vector<int> rows;
+        std::vector<int> group_begin;
+        for (int k = 0; k < n; k++) {
+            if (k == 0 || ids[order[k]] != ids[order[k - 1]]) {
+                rows.push_back(ids[order[k]]);
+                group_begin.push_back(k);
+            }
+        }
+        group_begin.push_back(n);
+
+        const int groups = static_cast<int>(rows.size());
+        parallel_for(0, groups, rows_per_chunk(dim, 1 << 12), [&](int begin, int end) {
+            for (int g = begin; g < end; g++) {
+                float32 *dst = table->grad[rows[g]];
+                for (int k = group_begin[g]; k < group_begin[g + 1]; k++) {
+                    const float32 *src = node.grad[order[k]];
+                    for (int j = 0; j < dim; j++) {
+                        dst[j] += src[j];
+                    }
+                }
+            }
+        });
+        table->mark_rows(rows);
+        clip_gradient_rows(table->grad, table->touched_rows, dim);
+    }
+};
+
+}  // namespace
+
+Value embedding(const Value &table, const std::vector<int> &ids) {
+    if (table.ptr->_backward == nullptr && table.orig != nullptr) {
+        table.ptr = table.orig;
+    }
+    Tensor *t = table.ptr.get();
+    for (int id : ids) {
+        if (id < 0 || id >= t->rows) {
+            throw std::invalid_argument("Embedding id " + std::to_string(id) + " out of range for " +
+                                        std::to_string(t->rows) + " rows");
+        }
+    }
+    const int n = static_cast<int>(ids.size());
+    AllocSiteScope site("embedding");
+    ProfileScope prof("embedding", 0.0, sizeof(float32) * 2.0 * n * t->cols);
+    prof.shapes(n, t->cols, t->rows, t->cols);
+
+    Tensor *result = new Tensor(n, t->cols);
+    Value out(result);
+    result->link(t);
+    result->name = "embedding(" + t->name + ")";
+    parallel_for(0, n, rows_per_chunk(t->cols), [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            std::memcpy(result->data[k], t->data[ids[k]], sizeof(float32) * t->cols);
+        }
+    });
+    result->ctx = std::make_shared<EmbeddingContext>(ids);
+    result->_backward = &Tensor::backcontext;
+    return out;
+}
@@ -0,0 +1,267 @@
+#include "exporter.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+enum class OpKind { Input, Constant, MatMul, Add, Sub, LeakyRelu };
+
+struct Node {
+    Tensor* t;
+    OpKind kind;
+    int a = -1;
+    int b = -1;
+    int consumers = 0;
+    bool materialize = false;
+    std::string name;  // array holding the node, for constants and materialized nodes
+};
+
+std::string literal(float v) {
+    if (!std::isfinite(v)) {
+        throw std::invalid_argument("export_model: non-finite value in graph");
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", v);
+    std::string s(buf);
+    if (s.find_first_of(".en") == std::string::npos) {
+        s += ".0";
+    }
+    return s + "f";
+}
+
+std::string identifier(const std::string& name, int id) {
+    std::string s = "c" + std::to_string(id) + "_";
+    for (char c : name) {
+        s += (std::isalnum(static_cast<unsigned char>(c)) ? c : '_');
+    }
+    return s;
+}
+
+std::string index(const std::string& i, int cols, const std::string& j) {
+    return "[" + i + " * " + std::to_string(cols) + " + " + j + "]";
+}
+
+class Lowering {
+private:
+    const Tensor* input;
+    std::vector<Node> nodes;
+    std::map<const Tensor*, int> ids;
+
+    int visit(Tensor* t) {
+        auto it = ids.find(t);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        Node n;
+        n.t = t;
+        if (t == input) {
+            n.kind = OpKind::Input;
+        } else if (!t->left && !t->right) {
+            n.kind = OpKind::Constant;
+        } else if (t->_backward == &Tensor::backmul) {
+            n.kind = OpKind::MatMul;
+        } else if (t->_backward == &Tensor::backadd) {
+            n.kind = OpKind::Add;
+        } else if (t->_backward == &Tensor::backsub) {
+            n.kind = OpKind::Sub;
+        } else if (t->_backward == &Tensor::backleakyrelu) {
+            n.kind = OpKind::LeakyRelu;
+        } else {
+            throw std::invalid_argument("export_model: unsupported op producing '" + t->name + "'");
+        }
+        if (n.kind != OpKind::Input && n.kind != OpKind::Constant) {
+            n.a = visit(t->left.get());
+            if (t->right) {
+                n.b = visit(t->right.get());
+            }
+        }
+        int id = static_cast<int>(nodes.size());
+        nodes.push_back(n);
+        ids[t] = id;
+        return id;
+    }
+
+    // Element (i, j) of node n. Constants and materialised nodes are array
+    // reads; elementwise ops inline their operands; a matmul feeding an
+    // elementwise op contributes its accumulator row, computed in `row_pre`.
+    std::string at(int id, const std::string& i, const std::string& j, std::string& row_pre, bool root = false) {
+        const Node& n = nodes[id];
+        if (n.kind == OpKind::Input) {
+            return "in" + index(i, n.t->cols, j);
+        }
+        if (n.kind == OpKind::Constant || (n.materialize && !root)) {
+            return n.name + index(i, n.t->cols, j);
+        }
+        switch (n.kind) {
+            case OpKind::Add:
+                return "(" + at(n.a, i, j, row_pre) + " + " + at(n.b, i, j, row_pre) + ")";
+            case OpKind::Sub:
+                return "(" + at(n.a, i, j, row_pre) + " - " + at(n.b, i, j, row_pre) + ")";
+            case OpKind::LeakyRelu:
+                return "leaky(" + at(n.a, i, j, row_pre) + ", " + literal(n.t->leaky) + ")";
+            case OpKind::MatMul: {
+                // Same k order as Tensor::operator*, vectorised over j.
+                const Node& a = nodes[n.a];
+                std::string acc = "acc" + std::to_string(id);
+                std::string a_ik = "a" + std::to_string(id);
+                std::string unused;
+                std::ostringstream os;
+                os << "        alignas(32) float " << acc << "[" << n.t->cols << "] = {};\n"
+                   << "        for (int k = 0; k < " << a.t->cols << "; k++) {\n"
+                   << "            const float " << a_ik << " = " << at(n.a, i, "k", unused) << ";\n"
+                   << "            for (int j = 0; j < " << n.t->cols << "; j++) {\n"
+                   << "                " << acc << "[j] += " << a_ik << " * " << at(n.b, "k", "j", unused) << ";\n"
+                   << "            }\n"
+                   << "        }\n";
+                row_pre += os.str();
+                return acc + "[" + j + "]";
+            }
+            default:
+                return "";
+        }
+    }
+
+    void emit_node(std::ostream& os, int id, const std::string& dst) {
+        const Node& n = nodes[id];
+        std::string row_pre;
+        std::string expr = at(id, "i", "j", row_pre, true);
+        os << "    // " << n.t->name << " [" << n.t->rows << "x" << n.t->cols << "]\n"
+           << "    for (int i = 0; i < " << n.t->rows << "; i++) {\n"
+           << row_pre
+           << "        for (int j = 0; j < " << n.t->cols << "; j++) {\n"
+           << "            " << dst << index("i", n.t->cols, "j") << " = " << expr << ";\n"
+           << "        }\n"
+           << "    }\n";
+    }
+
+    static void emit_array(std::ostream& os, const std::string& decl, const Tensor& t) {
+        os << decl << " = {";
+        for (int i = 0; i < t.rows; i++) {
+            for (int j = 0; j < t.cols; j++) {
+                int k = i * t.cols + j;
+                os << (k % 8 == 0 ? "\n    " : " ") << literal(t.data[i][j]) << ",";
+            }
+        }
+        os << "\n};\n";
+    }
+
+public:
+    Lowering(const Tensor* input) : input(input) {}
+
+    void generate(Tensor* output, std::ostream& os, const ExportOptions& options) {
+        int root = visit(output);
+        if (ids.find(input) == ids.end()) {
+            throw std::invalid_argument("export_model: input is not part of the output's graph");
+        }
+        if (root == ids[input]) {
+            throw std::invalid_argument("export_model: output is the input itself");
+        }
+
+        // Matmul operands are read at many indices, and shared nodes would be
+        // recomputed per consumer, so both get their own buffer.
+        for (Node& n : nodes) {
+            if (n.a >= 0) nodes[n.a].consumers++;
+            if (n.b >= 0) nodes[n.b].consumers++;
+        }
+        for (size_t id = 0; id < nodes.size(); id++) {
+            Node& n = nodes[id];
+            if (n.kind == OpKind::MatMul) {
+                for (int operand : {n.a, n.b}) {
+                    if (nodes[operand].kind != OpKind::Input && nodes[operand].kind != OpKind::Constant) {
+                        nodes[operand].materialize = true;
+                    }
+                }
+            }
+            if (n.kind != OpKind::Input && n.kind != OpKind::Constant && n.consumers > 1) {
+                n.materialize = true;
+            }
+            n.name = identifier(n.t->name, static_cast<int>(id));
+            if (n.kind != OpKind::Constant) {
+                n.name = "t" + std::to_string(id);
+            }
+        }
+        nodes[root].materialize = true;
+
+        const std::string& fn = options.function_name;
+        const Tensor& in_t = *nodes[ids[input]].t;
+        const Tensor& out_t = *output;
+
+        os << "// Generated by export_model() from '" << output->name << "'. Do not edit.\n"
+           << "// Standalone inference: no allocation, no dependencies.\n\n"
+           << "namespace {\n\n"
+           << "inline float leaky(float x, float slope) {\n"
+           << "    return x > 0 ? x : slope * x;\n"
+           << "}\n\n";
+        for (const Node& n : nodes) {
+            if (n.kind == OpKind::Constant) {
+                os << "// " << n.t->name << " [" << n.t->rows << "x" << n.t->cols << "]\n";
+                emit_array(os, "alignas(32) constexpr float " + n.name + "[" +
+                               std::to_string(n.t->rows * n.t->cols) + "]", *n.t);
+            }
+        }
+        os << "\n}  // namespace\n\n";
+
+        os << "// in: " << in_t.rows << "x" << in_t.cols << " row-major, out: "
+           << out_t.rows << "x" << out_t.cols << " row-major\n"
+           << "void " << fn << "(const float* in, float* out) {\n";
+        for (size_t id = 0; id < nodes.size(); id++) {
+            const Node& n = nodes[id];
+            if (n.materialize && static_cast<int>(id) != root) {
+                os << "    alignas(32) float " << n.name << "[" << n.t->rows * n.t->cols << "];\n";
+            }
+        }
+        for (size_t id = 0; id < nodes.size(); id++) {
+            if (nodes[id].materialize) {
+                emit_node(os, static_cast<int>(id), static_cast<int>(id) == root ? "out" : nodes[id].name);
+            }
+        }
+        os << "}\n";
+
+        if (options.self_test) {
+            int out_size = out_t.rows * out_t.cols;
+            os << "\n";
+            emit_array(os, "alignas(32) constexpr float " + fn + "_test_input[" +
+                           std::to_string(in_t.rows * in_t.cols) + "]", in_t);
+            emit_array(os, "alignas(32) constexpr float " + fn + "_test_output[" +
+                           std::to_string(out_size) + "]", out_t);
+            os << "\n// Number of outputs that differ from the library forward pass.\n"
+               << "int " << fn << "_self_test() {\n"
+               << "    float out[" << out_size << "];\n"
+               << "    " << fn << "(" << fn << "_test_input, out);\n"
+               << "    int mismatches = 0;\n"
+               << "    for (int i = 0; i < " << out_size << "; i++) {\n"
+               << "        mismatches += out[i] != " << fn << "_test_output[i];\n"
+               << "    }\n"
+               << "    return mismatches;\n"
+               << "}\n\n"
+               << "#ifdef ESP_EXPORT_SELF_TEST_MAIN\n"
+               << "#include <cstdio>\n\n"
+               << "int main() {\n"
+               << "    int mismatches = " << fn << "_self_test();\n"
+               << "    std::printf(\"" << fn << " parity: %d mismatching outputs\\n\", mismatches);\n"
+               << "    return mismatches == 0 ? 0 : 1;\n"
+               << "}\n"
+               << "#endif\n";
+        }
+    }
+};
+
+}  // namespace
+
+void export_model(const Value &output, const Value &input, const std::string &path,
+                  const ExportOptions &options) {
+    const Tensor* in = input.orig && input.ptr->_backward == nullptr ? input.orig.get() : input.ptr.get();
+    std::ostringstream source;
+    Lowering(in).generate(output.ptr.get(), source, options);
+
+    std::ofstream file(path);
+    if (!file || !(file << source.str())) {
+        throw std::runtime_error("export_model: cannot write " + path);
+    }
+}
@@ -0,0 +1,107 @@
+#include "hogwild.h"
+#include "memory_stats.h"
+#include "profiler.h"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+void apply_row(float32 *w, float32 *g, int cols, float lr, HogwildWrite write) {
+    for (int j = 0; j < cols; j++) {
+        if (g[j] == 0.0f) {
+            continue;
+        }
+        const float32 delta = lr * g[j];
+        g[j] = 0.0f;
+        float32 cur;
+        __atomic_load(&w[j], &cur, __ATOMIC_RELAXED);
+        float32 next = cur - delta;
+        if (write == HogwildWrite::Relaxed) {
+            __atomic_store(&w[j], &next, __ATOMIC_RELAXED);
+            continue;
+        }
+        // On failure cur is reloaded with the value another worker stored.
+        while (!__atomic_compare_exchange(&w[j], &cur, &next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            next = cur - delta;
+        }
+    }
+}
+
+// Write one replica's gradient into the shared weights and zero it.
+void apply(Tensor &replica, const HogwildConfig &config) {
+    ProfileScope prof("hogwild_update", 2.0 * replica.rows * replica.cols,
+                      sizeof(float32) * 3.0 * replica.rows * replica.cols);
+    prof.shapes(replica.rows, replica.cols);
+    if (config.sparse_updates && !replica.touched_rows.empty()) {
+        for (int i : replica.touched_rows) {
+            apply_row(replica.data[i], replica.grad[i], replica.cols, config.learning_rate, config.write);
+        }
+        replica.touched_rows.clear();
+        return;
+    }
+    for (int i = 0; i < replica.rows; i++) {
+        apply_row(replica.data[i], replica.grad[i], replica.cols, config.learning_rate, config.write);
+    }
+    replica.touched_rows.clear();
+}
+
+}  // namespace
+
+HogwildTrainer::HogwildTrainer(std::vector<Value *> params, HogwildConfig config)
+    : params(std::move(params)), config(config) {
+    if (this->config.threads < 1) {
+        this->config.threads = 1;
+    }
+}
+
+std::vector<float> HogwildTrainer::train(int steps, const StepFn &step) {
+    std::vector<float> losses(steps > 0 ? steps : 0);
+    std::atomic<int> next_step{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto run = [&](int worker) {
+        set_thread_inline(true);
+        std::vector<Value> replicas;
+        {
+            AllocSiteScope site("hogwild_replica");
+            for (Value *v : params) {
+                Tensor *t = v->orig ? v->orig.get() : v->ptr.get();
+                Value r(t->replica());
+                r.orig = r.ptr;
+                replicas.push_back(r);
+            }
+        }
+        try {
+            for (int s = next_step++; s < steps && !failed.load(std::memory_order_relaxed); s = next_step++) {
+                losses[s] = step(worker, s, replicas);
+                for (Value &r : replicas) {
+                    apply(*r.orig, config);
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            failed.store(true);
+        }
+        set_thread_inline(false);
+    };
+
+    std::vector<std::thread> threads;
+    for (int w = 1; w < config.threads; w++) {
+        threads.emplace_back(run, w);
+    }
+    run(0);
+    for (auto &t : threads) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return losses;
+}
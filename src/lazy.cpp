@@ -0,0 +1,283 @@
+#include "lazy.h"
+#include "memory_stats.h"
+#include "parallel.h"
+#include "profiler.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+enum ExprKind { LEAF, ADD, SUB, MUL, DIV, LEAKYRELU };
+
+struct ExprNode {
+    ExprKind kind;
+    std::shared_ptr<const ExprNode> a, b;
+    boost::intrusive_ptr<Tensor> leaf;
+    float alpha = 0.0f;
+};
+
+namespace {
+
+// Columns processed per tile; n_instr * TILE floats of scratch stay in L1.
+constexpr int TILE = 256;
+
+struct Instr {
+    ExprKind kind;
+    int a;  // operand instruction, or input index for LEAF
+    int b;
+    float alpha;
+};
+
+// The recorded DAG flattened into a straight-line program. Leaves come
+// first and appear once per distinct input tensor.
+struct Program {
+    std::vector<Instr> code;
+    std::vector<const Tensor*> inputs;
+    std::string name;
+};
+
+const char* kind_symbol(ExprKind kind) {
+    switch (kind) {
+        case ADD: return "+";
+        case SUB: return "-";
+        case MUL: return "⊙";
+        case DIV: return "/";
+        default: return "";
+    }
+}
+
+int flatten(const std::shared_ptr<const ExprNode>& n, Program& prog,
+            std::map<const ExprNode*, int>& seen, std::map<const Tensor*, int>& leaves,
+            std::vector<std::string>& names) {
+    auto it = seen.find(n.get());
+    if (it != seen.end()) {
+        return it->second;
+    }
+    int id;
+    if (n->kind == LEAF) {
+        auto leaf = leaves.find(n->leaf.get());
+        if (leaf != leaves.end()) {
+            id = leaf->second;
+        } else {
+            int input = static_cast<int>(prog.inputs.size());
+            prog.inputs.push_back(n->leaf.get());
+            id = static_cast<int>(prog.code.size());
+            prog.code.push_back(Instr{LEAF, input, -1, 0.0f});
+            names.push_back(n->leaf->name);
+            leaves[n->leaf.get()] = id;
+        }
+    } else {
+        int a = flatten(n->a, prog, seen, leaves, names);
+        int b = n->b ? flatten(n->b, prog, seen, leaves, names) : -1;
+        id = static_cast<int>(prog.code.size());
+        prog.code.push_back(Instr{n->kind, a, b, n->alpha});
+        names.push_back(n->kind == LEAKYRELU ? names[a] + "leakyrelu"
+                                             : "(" + names[a] + kind_symbol(n->kind) + names[b] + ")");
+    }
+    seen[n.get()] = id;
+    return id;
+}
+
+// Evaluate every instruction for columns [j0, j0 + width) of row i. Leaves
+// point straight into the input rows; other results go to scratch.
+void run_tile(const Program& prog, const std::vector<Tensor*>& inputs, int i, int j0, int width,
+              float* scratch, const float** val) {
+    for (size_t k = 0; k < prog.code.size(); k++) {
+        const Instr& in = prog.code[k];
+        if (in.kind == LEAF) {
+            val[k] = inputs[in.a]->data[i] + j0;
+            continue;
+        }
+        float* dst = scratch + k * TILE;
+        const float* x = val[in.a];
+        const float* y = in.b >= 0 ? val[in.b] : nullptr;
+        switch (in.kind) {
+            case ADD:
+                for (int t = 0; t < width; t++) dst[t] = x[t] + y[t];
+                break;
+            case SUB:
+                for (int t = 0; t < width; t++) dst[t] = x[t] - y[t];
+                break;
+            case MUL:
+                for (int t = 0; t < width; t++) dst[t] = x[t] * y[t];
+                break;
+            case DIV:
+                for (int t = 0; t < width; t++) dst[t] = x[t] / y[t];
+                break;
+            case LEAKYRELU:
+                for (int t = 0; t < width; t++) dst[t] = x[t] > 0 ? x[t] : in.alpha * x[t];
+                break;
+            default:
+                break;
+        }
+        val[k] = dst;
+    }
+}
+
+std::vector<Tensor*> node_inputs(const Tensor& node, size_t count) {
+    std::vector<Tensor*> inputs(count);
+    for (size_t k = 0; k < count; k++) {
+        inputs[k] = node.input(k);
+    }
+    return inputs;
+}
+
+struct FusedContext : OpContext {
+    Program prog;
+
+    explicit FusedContext(Program prog) : prog(std::move(prog)) {}
+
+    void backward(Tensor& node) override {
+        size_t n = prog.code.size();
+        ProfileScope prof("backfused", 3.0 * n * node.rows * node.cols,
+                          sizeof(float32) * (2.0 * prog.inputs.size() + 1.0) * node.rows * node.cols);
+        prof.shapes(node.rows, node.cols, node.rows, node.cols);
+        std::vector<Tensor*> inputs = node_inputs(node, prog.inputs.size());
+
+        parallel_for(0, node.rows, rows_per_chunk(node.cols, 1 << 12), [&](int begin, int end) {
+            std::vector<float> scratch(n * TILE);
+            std::vector<float> adj(n * TILE);
+            std::vector<const float*> val(n);
+            for (int i = begin; i < end; i++) {
+                for (int j0 = 0; j0 < node.cols; j0 += TILE) {
+                    int width = std::min(TILE, node.cols - j0);
+                    run_tile(prog, inputs, i, j0, width, scratch.data(), val.data());
+                    std::fill(adj.begin(), adj.end(), 0.0f);
+                    std::copy(node.grad[i] + j0, node.grad[i] + j0 + width, adj.data() + (n - 1) * TILE);
+
+                    for (size_t k = n; k-- > 0;) {
+                        const Instr& in = prog.code[k];
+                        const float* g = adj.data() + k * TILE;
+                        if (in.kind == LEAF) {
+                            float* dst = inputs[in.a]->grad[i] + j0;
+                            for (int t = 0; t < width; t++) dst[t] += g[t];
+                            continue;
+                        }
+                        float* ga = adj.data() + in.a * TILE;
+                        float* gb = in.b >= 0 ? adj.data() + in.b * TILE : nullptr;
+                        const float* x = val[in.a];
+                        const float* y = in.b >= 0 ? val[in.b] : nullptr;
+                        switch (in.kind) {
+                            case ADD:
+                                for (int t = 0; t < width; t++) { ga[t] += g[t]; gb[t] += g[t]; }
+                                break;
+                            case SUB:
+                                for (int t = 0; t < width; t++) { ga[t] += g[t]; gb[t] -= g[t]; }
+                                break;
+                            case MUL:
+                                for (int t = 0; t < width; t++) { ga[t] += g[t] * y[t]; gb[t] += g[t] * x[t]; }
+                                break;
+                            case DIV:
+                                for (int t = 0; t < width; t++) {
+                                    ga[t] += g[t] / y[t];
+                                    gb[t] -= g[t] * x[t] / (y[t] * y[t]);
+                                }
+                                break;
+                            case LEAKYRELU:
+                                for (int t = 0; t < width; t++) ga[t] += x[t] > 0 ? g[t] : in.alpha * g[t];
+                                break;
+                            default:
+                                break;
+                        }
+                    }
+                }
+            }
+        });
+        for (Tensor* input : inputs) {
+            clip_gradient(input->grad, input->rows, input->cols);
+        }
+    }
+};
+
+}  // namespace
+
+LazyExpr::LazyExpr(std::shared_ptr<const ExprNode> node, int rows, int cols)
+    : node(std::move(node)), rows(rows), cols(cols) {}
+
+LazyExpr::LazyExpr(const Value &v) {
+    if (v.ptr->_backward == nullptr && v.orig != nullptr) {
+        v.ptr = v.orig;
+    }
+    auto leaf = std::make_shared<ExprNode>();
+    leaf->kind = LEAF;
+    leaf->leaf = v.ptr;
+    node = leaf;
+    rows = v.ptr->rows;
+    cols = v.ptr->cols;
+}
+
+LazyExpr LazyExpr::binary(int kind, const LazyExpr &other, const char *op) const {
+    if (rows != other.rows || cols != other.cols) {
+        throw std::invalid_argument(std::string("Matrix dimensions must match for lazy ") + op);
+    }
+    auto n = std::make_shared<ExprNode>();
+    n->kind = static_cast<ExprKind>(kind);
+    n->a = node;
+    n->b = other.node;
+    return LazyExpr(n, rows, cols);
+}
+
+LazyExpr LazyExpr::operator+(const LazyExpr &other) const {
+    return binary(ADD, other, "+");
+}
+
+LazyExpr LazyExpr::operator-(const LazyExpr &other) const {
+    return binary(SUB, other, "-");
+}
+
+LazyExpr LazyExpr::operator/(const LazyExpr &other) const {
+    return binary(DIV, other, "/");
+}
+
+LazyExpr LazyExpr::hadamard(const LazyExpr &other) const {
+    return binary(MUL, other, "hadamard");
+}
+
+LazyExpr LazyExpr::leakyrelu(float leaky) const {
+    auto n = std::make_shared<ExprNode>();
+    n->kind = LEAKYRELU;
+    n->a = node;
+    n->alpha = leaky;
+    return LazyExpr(n, rows, cols);
+}
+
+Value LazyExpr::eval() const {
+    Program prog;
+    std::map<const ExprNode*, int> seen;
+    std::map<const Tensor*, int> leaves;
+    std::vector<std::string> names;
+    flatten(node, prog, seen, leaves, names);
+    prog.name = names.back();
+
+    // A bare leaf needs no kernel; hand the tensor back as-is.
+    if (prog.code.size() == 1) {
+        return Value(const_cast<Tensor*>(prog.inputs[0]));
+    }
+
+    size_t n = prog.code.size();
+    AllocSiteScope site("fused_elementwise");
+    ProfileScope prof("fused_elementwise", 1.0 * (n - prog.inputs.size()) * rows * cols,
+                      sizeof(float32) * (prog.inputs.size() + 1.0) * rows * cols);
+    prof.shapes(rows, cols, rows, cols);
+
+    Tensor* result = new Tensor(rows, cols);
+    Value out(result);
+    result->link(prog.inputs);
+    result->name = prog.name;
+    std::vector<Tensor*> inputs = node_inputs(*result, prog.inputs.size());
+
+    parallel_for(0, rows, rows_per_chunk(cols, 1 << 12), [&](int begin, int end) {
+        std::vector<float> scratch(n * TILE);
+        std::vector<const float*> val(n);
+        for (int i = begin; i < end; i++) {
+            for (int j0 = 0; j0 < cols; j0 += TILE) {
+                int width = std::min(TILE, cols - j0);
+                run_tile(prog, inputs, i, j0, width, scratch.data(), val.data());
+                std::copy(val[n - 1], val[n - 1] + width, result->data[i] + j0);
+            }
+        }
+    });
+
+    result->ctx = std::make_shared<FusedContext>(std::move(prog));
+    result->_backward = &Tensor::backcontext;
+    return out;
+}
@@ -11,6 +11,10 @@
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <value.h>
 #include <timer.h>
+#include <memory_stats.h>
+#include <exporter.h>
+#include <perf_counters.h>
+#include <snapshot.h>
 
 /**
  * @brief Get the peak memory usage of the current process
@@ -25,42 +29,6 @@ long getPeakMemoryUsage() {
     return -1;
 }
 
-/**
- * @brief Calculate Mean Squared Error and its gradient
- * @param y_true True values
- * @param y_pred Predicted values
- * @return MSE loss value
- */
-float mmse(Value &y_true, Value &y_pred) {
-    float result = 0.0f;
-    
-    // Check dimensions match
-    if (y_true.ptr->rows != y_pred.ptr->rows || y_true.ptr->cols != y_pred.ptr->cols) {
-        std::cerr << "Error: y_true and y_pred must have the same shape" << std::endl;
-        return result;
-    }
-
-    // Calculate MSE
-    for (int i = 0; i < y_true.ptr->rows; i++) {
-        for (int j = 0; j < y_true.ptr->cols; j++) {
-            float diff = y_true.ptr->data[i][j] - y_pred.ptr->data[i][j];
-            result += diff * diff;
-        }
-    }
-    result /= static_cast<float>(y_true.ptr->rows * y_true.ptr->cols);
-
-    // Calculate gradients if required
-    if (y_pred.ptr->grad) {
-        float scale = 2.0f / static_cast<float>(y_pred.ptr->rows * y_pred.ptr->cols);
-        for (int i = 0; i < y_pred.ptr->rows; i++) {
-            for (int j = 0; j < y_pred.ptr->cols; j++) {
-                y_pred.ptr->grad[i][j] = scale * (y_pred.ptr->data[i][j] - y_true.ptr->data[i][j]);
-            }
-        }
-    }
-    return result;
-}
-
 /**
  * @brief Create a 2D array with initialization function
  * @param rows Number of rows
@@ -109,8 +77,8 @@ int main()
    });
 
    // Create Value objects for training
-   Value x_train(num_points, 2, x_data, "x_train");  // [x, bias]
-   Value y_train(num_points, 1, y_data, "y_train");  // [sin(x)]
+   Value x_train(num_points, 2, x_data, "x_train", MemCategory::Activation);  // [x, bias]
+   Value y_train(num_points, 1, y_data, "y_train", MemCategory::Activation);  // [sin(x)]
 
     // Initialize model parameters
     std::random_device rd;
@@ -143,9 +111,25 @@ int main()
     const int max_epochs = 10000;
     Timer total_timer("Total training time");
     double epoch_time = 0.0;
-    
-    for (int epoch = 0; epoch < max_epochs; epoch++) {
+
+    // Snapshot every 50 epochs and resume from <path> when ESP_CHECKPOINT=<path> is set
+    std::unique_ptr<AsyncCheckpointer> checkpointer;
+    int start_epoch = 0;
+    if (const char *checkpoint_path = std::getenv("ESP_CHECKPOINT")) {
+        checkpointer.reset(new AsyncCheckpointer(checkpoint_path));
+        checkpointer->add(W1);
+        checkpointer->add(W2);
+        checkpointer->add(b);
+        int64_t saved_epoch;
+        if (checkpointer->restore(&saved_epoch)) {
+            start_epoch = static_cast<int>(saved_epoch);
+            std::cout << "Resumed from " << checkpoint_path << " at epoch " << start_epoch << std::endl;
+        }
+    }
+
+    for (int epoch = start_epoch; epoch < max_epochs; epoch++) {
         Timer epoch_timer;
+        CounterScope step_counters("train_step");  // ESP_PERF_COUNTERS=1
         
         // Forward pass
         Value hidden = x_train * W1;        // [num_points x 6]
@@ -153,8 +137,9 @@ int main()
         Value out = hidden_act * W2;        // [num_points x 1]
 
         // Compute loss and gradients
-        float loss = mmse(y_train, out);
-        out.backward();  // Backpropagate gradients
+        Value mse = out.mse(y_train);
+        float loss = mse.item();
+        mse.backward();  // Backpropagate gradients from the scalar loss
 
         // Update parameters
         W1.update(learning_rate);
@@ -167,6 +152,10 @@ int main()
         b.setgradzero();
         out.setgradzero();
 
+        if (checkpointer && (epoch + 1) % 50 == 0) {
+            checkpointer->snapshot(epoch + 1);
+        }
+
         // Print training progress
         if (epoch % 50 == 0) {
             epoch_time = epoch_timer.stop();
@@ -179,6 +168,17 @@ int main()
         }
     }
 
+    if (checkpointer) {
+        checkpointer->wait();
+        SnapshotStats stats = checkpointer->stats();
+        std::cout << "Checkpoints: " << stats.written << " written, " << stats.superseded << " superseded, "
+                  << stats.failed << " failed, max stall " << stats.max_stall_ms << " ms";
+        if (!stats.last_error.empty()) {
+            std::cout << " (" << stats.last_error << ")";
+        }
+        std::cout << std::endl;
+    }
+
     // Print final parameters
     std::cout << "\nFinal parameters:" << std::endl;
     std::cout << "W: ";
@@ -187,6 +187,23 @@ int main()
     std::cout << "b: ";
     b.printdata();
 
+    // Export the trained model as standalone C++ when ESP_EXPORT=<path> is set
+    if (const char *export_path = std::getenv("ESP_EXPORT")) {
+        float **probe_data = create_data_array(1, 2, [](int i, int j) -> float {
+            return j == 1 ? 1.0f : 0.5f;
+        });
+        {
+            // The traced graph never runs backward, so release it (and its
+            // links to W1/W2) as soon as the source is written.
+            Value probe(1, 2, probe_data, "x", MemCategory::Activation);
+            Value probe_out = (probe * W1).leakyrelu() * W2;
+            export_model(probe_out, probe, export_path);
+        }
+        std::cout << "Exported model to " << export_path << std::endl;
+        free(probe_data[0]);
+        free(probe_data);
+    }
+
     // Model evaluation
     std::cout << "\nTesting the model on points from 0 to 2π:" << std::endl;
     std::cout << "----------------------------------------\n";
@@ -205,7 +222,7 @@ int main()
         });
         
         // Forward pass through network
-        Value input(1, 2, input_data, "test_input");
+        Value input(1, 2, input_data, "test_input", MemCategory::Activation);
         Value hidden = input * W1;
         Value hidden_act = hidden.leakyrelu();
         Value pred = hidden_act * W2;
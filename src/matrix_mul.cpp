@@ -1,15 +1,54 @@
 #include "matrix_mul.h"
+#include "profiler.h"
+#include "memory_stats.h"
+#include "parallel.h"
 #include <memory>
 #include <unordered_set>
 #include <cstring>
 #include <cmath>   
+#include <algorithm>
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 
 const float CLIP_NORM = 1.0f;
 const float MIN_GRAD_NORM = 1e-3f;  
 const float EPSILON = 1e-6f;        
 
+static bool& clipping_flag() {
+    thread_local bool on = true;
+    return on;
+}
+
+void set_gradient_clipping(bool on) {
+    clipping_flag() = on;
+}
+
+bool gradient_clipping() {
+    return clipping_flag();
+}
+
+static std::vector<float**>& deferred_grads() {
+    thread_local std::vector<float**> grads;
+    return grads;
+}
+
+void set_deferred_clipping(std::vector<float**> grads) {
+    deferred_grads() = std::move(grads);
+}
+
+static bool skip_clipping(float** grad) {
+    if (!clipping_flag()) {
+        return true;
+    }
+    const std::vector<float**>& deferred = deferred_grads();
+    return std::find(deferred.begin(), deferred.end(), grad) != deferred.end();
+}
+
 void clip_gradient(float** grad, int rows, int cols) {
+    if (skip_clipping(grad)) {
+        return;
+    }
+    ProfileScope prof("clip_gradient", 3.0 * rows * cols, 2.0 * sizeof(float32) * rows * cols);
+    prof.shapes(rows, cols, rows, cols);
     float norm = 0.0f;
 
     for (int i = 0; i < rows; i++) {
@@ -39,12 +78,44 @@ void clip_gradient(float** grad, int rows, int cols) {
     }
 }
 
+void clip_gradient_rows(float** grad, const std::vector<int>& row_ids, int cols) {
+    if (skip_clipping(grad)) {
+        return;
+    }
+    ProfileScope prof("clip_gradient_rows", 3.0 * row_ids.size() * cols, 2.0 * sizeof(float32) * row_ids.size() * cols);
+    prof.shapes(static_cast<int>(row_ids.size()), cols, static_cast<int>(row_ids.size()), cols);
+    float norm = 0.0f;
+
+    for (int i : row_ids) {
+        for (int j = 0; j < cols; j++) {
+            if (!std::isfinite(grad[i][j])) {
+                grad[i][j] = 0.0f;
+            }
+            norm += grad[i][j] * grad[i][j];
+        }
+    }
+    norm = sqrt(norm + EPSILON);
+    float scale = 1.0f;
+    if (norm > CLIP_NORM) {
+        scale = CLIP_NORM / norm;
+    } else if (norm < MIN_GRAD_NORM) {
+        scale = MIN_GRAD_NORM / (norm + EPSILON);
+    }
+    if (scale != 1.0f) {
+        for (int i : row_ids) {
+            for (int j = 0; j < cols; j++) {
+                grad[i][j] *= scale;
+            }
+        }
+    }
+}
+
 Tensor& Tensor::operator=(const Tensor& t) {
     if (this == &t) {
         return *this;
     }
 
-    Tensor* new_tensor = new Tensor(t.rows, t.cols);
+    Tensor* new_tensor = new Tensor(t.rows, t.cols, nullptr, "", t.category);
 
     for (int j = 0; j < t.rows; j++) {
         memcpy(new_tensor->data[j], t.data[j], t.cols * sizeof(float32));
@@ -52,8 +123,10 @@ Tensor& Tensor::operator=(const Tensor& t) {
 
     new_tensor->name = t.name;
     new_tensor->_backward = t._backward;
+    new_tensor->ctx = t.ctx;
     new_tensor->left = t.left;   
     new_tensor->right = t.right;
+    new_tensor->extra_inputs = t.extra_inputs;
     
     data_holder.reset();
     grad_holder.reset();
@@ -67,9 +140,14 @@ Tensor& Tensor::operator=(const Tensor& t) {
     this->cols = new_tensor->cols;
     this->left = std::move(new_tensor->left);
     this->right = std::move(new_tensor->right);
+    this->extra_inputs = std::move(new_tensor->extra_inputs);
     this->name = std::move(new_tensor->name);
+    this->category = new_tensor->category;
+    this->leaky = t.leaky;
+    setGraphNode(this->left || this->right);
 
     this->_backward = new_tensor->_backward;
+    this->ctx = std::move(new_tensor->ctx);
 
     uuid_generate(this->id);
     char uuid_str[37];
@@ -81,10 +159,12 @@ Tensor& Tensor::operator=(const Tensor& t) {
 }
 
 Tensor Tensor::operator+(const Tensor &t) const {
+    AllocSiteScope site("operator+");
+    ProfileScope prof("operator+", 1.0 * rows * cols, 3.0 * sizeof(float32) * rows * cols);
+    prof.shapes(rows, cols, rows, cols, t.rows, t.cols);
     Tensor result(this->rows, this->cols);
 
-    result.left = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(this));
-    result.right = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(&t));
+    result.link(this, &t);
     result.name = this->name + "+" + t.name;
     for (int j = 0; j < rows; j++) {
         for (int k = 0; k < cols; k++) {
@@ -96,9 +176,11 @@ Tensor Tensor::operator+(const Tensor &t) const {
 }
 
 Tensor Tensor::operator-(const Tensor &t) const {
+    AllocSiteScope site("operator-");
+    ProfileScope prof("operator-", 1.0 * rows * cols, 3.0 * sizeof(float32) * rows * cols);
+    prof.shapes(rows, cols, rows, cols, t.rows, t.cols);
     Tensor result(this->rows, this->cols);
-    result.left = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(this));
-    result.right = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(&t));
+    result.link(this, &t);
     result.name = this->name + "-" + t.name;
 
     for (int j = 0; j < rows; j++) {
@@ -111,6 +193,8 @@ Tensor Tensor::operator-(const Tensor &t) const {
 }
 
 void Tensor::backsub(){
+    ProfileScope prof("backsub", 2.0 * rows * cols, 6.0 * sizeof(float32) * rows * cols);
+    prof.shapes(rows, cols, rows, cols, rows, cols);
     if(this->left){
         for(int i = 0;i<this->rows;i++){
             for(int j = 0;j<this->cols;j++){
@@ -130,6 +214,8 @@ void Tensor::backsub(){
 }
 
 void Tensor::backadd() {
+    ProfileScope prof("backadd", 2.0 * rows * cols, 6.0 * sizeof(float32) * rows * cols);
+    prof.shapes(rows, cols, rows, cols, rows, cols);
     if (this->left) {
         for (int i = 0; i < this->rows; i++) {
             for (int j = 0; j < this->cols; j++) {
@@ -149,9 +235,11 @@ void Tensor::backadd() {
 }
 
 Tensor Tensor::operator/(const Tensor &t) const {
+    AllocSiteScope site("operator/");
+    ProfileScope prof("operator/", 1.0 * rows * cols, 3.0 * sizeof(float32) * rows * cols);
+    prof.shapes(rows, cols, rows, cols, t.rows, t.cols);
     Tensor result(this->rows, this->cols);
-    result.left = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(this));
-    result.right = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(&t));
+    result.link(this, &t);
     result.name = this->name + "/" + t.name;
 
     for (int j = 0; j < rows; j++) {
@@ -162,24 +250,64 @@ Tensor Tensor::operator/(const Tensor &t) const {
     return result;
 }
 
+void gemm_nn(const float* const* A, const float* const* B, float** C, int M, int K, int N) {
+    parallel_for(0, M, rows_per_chunk(K * N), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float* c = C[i];
+            for (int k = 0; k < K; k++) {
+                const float a = A[i][k];
+                const float* b = B[k];
+                for (int j = 0; j < N; j++) {
+                    c[j] += a * b[j];
+                }
+            }
+        }
+    });
+}
+
+void gemm_nt(const float* const* A, const float* const* B, float** C, int M, int K, int N) {
+    parallel_for(0, M, rows_per_chunk(K * N), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            for (int j = 0; j < N; j++) {
+                float acc = C[i][j];
+                for (int k = 0; k < K; k++) {
+                    acc += A[i][k] * B[j][k];
+                }
+                C[i][j] = acc;
+            }
+        }
+    });
+}
+
+void gemm_tn(const float* const* A, const float* const* B, float** C, int M, int K, int N) {
+    parallel_for(0, M, rows_per_chunk(K * N), [&](int begin, int end) {
+        for (int k = 0; k < K; k++) {
+            const float* b = B[k];
+            for (int i = begin; i < end; i++) {
+                const float a = A[k][i];
+                float* c = C[i];
+                for (int j = 0; j < N; j++) {
+                    c[j] += a * b[j];
+                }
+            }
+        }
+    });
+}
+
 Tensor Tensor::operator*(const Tensor &t) const {
     if (this->cols != t.rows) {
         throw std::invalid_argument("Matrix dimensions do not match for multiplication");
     }
+    AllocSiteScope site("operator*");
+    ProfileScope prof("operator*", 2.0 * rows * cols * t.cols,
+                      sizeof(float32) * (1.0 * rows * cols + 1.0 * t.rows * t.cols + 1.0 * rows * t.cols));
+    prof.shapes(rows, t.cols, rows, cols, t.rows, t.cols);
 
     Tensor result(this->rows, t.cols);
-    result.left = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(this));
-    result.right = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(&t));
+    result.link(this, &t);
     result.name = this->name + "*" + t.name;
     result._backward = &Tensor::backmul;
-    for (int i = 0; i < this->rows; i++) {
-        for (int j = 0; j < t.cols; j++) {
-            result.data[i][j] = 0;
-            for (int k = 0; k < this->cols; k++) {
-                result.data[i][j] += this->data[i][k] * t.data[k][j];
-            }
-        }
-    }
+    gemm_nn(data, t.data, result.data, rows, cols, t.cols);
     return result;
 }
 
@@ -191,24 +319,19 @@ void Tensor::backmul(){
     // dL/dA (3x2)
     // dL/dB = dL/dA * C^T
     // dL/dC = B^T * dL/dA
+    // Shapes from whichever operands are set; a missing one counts as empty.
+    int l_rows = left ? left->rows : 0, l_cols = left ? left->cols : 0;
+    int r_rows = right ? right->rows : 0, r_cols = right ? right->cols : 0;
+    int inner = left ? l_cols : r_rows;
+    ProfileScope prof("backmul", 2.0 * rows * cols * inner * ((left ? 1 : 0) + (right ? 1 : 0)),
+                      2.0 * sizeof(float32) * (1.0 * rows * cols + 2.0 * l_rows * l_cols + 2.0 * r_rows * r_cols));
+    prof.shapes(rows, cols, l_rows, l_cols, r_rows, r_cols);
     if(this->left){
-        for(int i = 0; i<this->rows;i++){
-            for(int j = 0;j<this->right->rows;j++){
-                for(int k = 0;k<this->cols;k++){
-                    left->grad[i][j] += this->grad[i][k] * right->data[j][k];
-                }
-            }
-        }
+        gemm_nt(this->grad, right->data, left->grad, this->rows, this->cols, right->rows);
         clip_gradient(left->grad,this->left->rows, this->left->cols);
     }
     if(this->right){
-        for(int i = 0;i<this->left->cols;i++){
-            for(int j = 0;j<this->cols;j++){
-                for(int k = 0;k<this->rows;k++){
-                    right->grad[i][j] += this->grad[k][j] * left->data[k][i];
-                }
-            }
-        }
+        gemm_tn(left->data, this->grad, right->grad, left->cols, this->rows, this->cols);
         clip_gradient(right->grad, this->right->rows, this->right->cols);
     }
 }
@@ -217,10 +340,12 @@ Tensor Tensor::operator^(const Tensor &t) const {
     if (this->cols != 1 || t.cols !=1 || this ->rows != t.rows) {
         throw std::invalid_argument("Matrix dimensions do not match for dot multiplication");
     }
+    AllocSiteScope site("operator^");
+    ProfileScope prof("operator^", 2.0 * rows, 2.0 * sizeof(float32) * rows);
+    prof.shapes(1, 1, rows, cols, t.rows, t.cols);
 
     Tensor result(t.cols, t.cols);
-    result.left = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(this));
-    result.right = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(&t));
+    result.link(this, &t);
     result.name = this->name + "^" + t.name;
 
     for (int i = 0;i<this->rows;i++){
@@ -231,6 +356,10 @@ Tensor Tensor::operator^(const Tensor &t) const {
 }
 
 void Tensor::backdot(){
+    int n = left ? left->rows : (right ? right->rows : 0);
+    ProfileScope prof("backdot", 4.0 * n, 6.0 * sizeof(float32) * n);
+    prof.shapes(rows, cols, left ? left->rows : 0, left ? left->cols : 0, right ? right->rows : 0,
+                right ? right->cols : 0);
     if(this->left){
         for(int i = 0;i<this->left->rows;i++){
             left->grad[i][0] += ((this->grad[0][0] * right->data[i][0]));
@@ -246,23 +375,32 @@ void Tensor::backdot(){
 }
 
 Tensor Tensor::lekyrelu(float leaky){
+    AllocSiteScope site("lekyrelu");
+    ProfileScope prof("lekyrelu", 1.0 * rows * cols, 2.0 * sizeof(float32) * rows * cols);
+    prof.shapes(rows, cols, rows, cols);
     Tensor result(this->rows, this->cols);
-    result.left = boost::intrusive_ptr<Tensor>(const_cast<Tensor*>(this));
+    result.link(this);
     result.name = this->name + "leakyrelu";
     for (int i = 0; i < this->rows; i++) {
         for (int j = 0; j < this->cols; j++) {
             result.data[i][j] = this->data[i][j] > 0 ? this->data[i][j] : leaky * this->data[i][j];
         }
     }
+    result.leaky = leaky;
     result._backward = &Tensor::backleakyrelu;
     return result;
 }
 
+// Uses the float slope recorded by lekyrelu, as the forward, lazy and exported
+// paths do. The old hard-coded double 0.01 rounded the negative branch
+// differently, so default-slope gradients may differ in the last bit.
 void Tensor::backleakyrelu() {
+    ProfileScope prof("backleakyrelu", 2.0 * rows * cols, 4.0 * sizeof(float32) * rows * cols);
+    prof.shapes(rows, cols, rows, cols);
     if (this->left) {
         for (int i = 0; i < this->rows; i++) {
             for (int j = 0; j < this->cols; j++) {
-                left->grad[i][j] += (this->data[i][j]) > 0 ? this->grad[i][j] : 0.01 * this->grad[i][j];
+                left->grad[i][j] += (this->data[i][j]) > 0 ? this->grad[i][j] : leaky * this->grad[i][j];
             }
         }
         clip_gradient(left->grad,this->left->rows, this->left->cols);
@@ -270,6 +408,221 @@ void Tensor::backleakyrelu() {
 }
 
 
+static void check_axis(int axis) {
+    if (axis < -1 || axis > 1) {
+        throw std::invalid_argument("Reduction axis must be -1, 0 or 1");
+    }
+}
+
+// Shared forward for sum/mean: result shape follows the axis, every output
+// element is the (scaled) sum of the inputs it covers.
+static void reduce_into(const Tensor& in, Tensor& out, int axis, float scale) {
+    if (axis == -1) {
+        double total = parallel_reduce(0, in.rows, rows_per_chunk(in.cols), [&](int begin, int end) {
+            double acc = 0.0;
+            for (int i = begin; i < end; i++) {
+                const float* row = in.data[i];
+                for (int j = 0; j < in.cols; j++) {
+                    acc += row[j];
+                }
+            }
+            return acc;
+        });
+        out.data[0][0] = static_cast<float>(total * scale);
+    } else if (axis == 0) {
+        parallel_for(0, in.cols, rows_per_chunk(in.rows), [&](int begin, int end) {
+            float* dst = out.data[0];
+            for (int i = 0; i < in.rows; i++) {
+                const float* row = in.data[i];
+                for (int j = begin; j < end; j++) {
+                    dst[j] += row[j];
+                }
+            }
+            for (int j = begin; j < end; j++) {
+                dst[j] *= scale;
+            }
+        });
+    } else {
+        parallel_for(0, in.rows, rows_per_chunk(in.cols), [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const float* row = in.data[i];
+                float acc = 0.0f;
+                for (int j = 0; j < in.cols; j++) {
+                    acc += row[j];
+                }
+                out.data[i][0] = acc * scale;
+            }
+        });
+    }
+}
+
+// Broadcast the output grad back over the reduced axis. The axis is implied
+// by the output shape: a dimension of 1 was reduced. Like every loss root,
+// the gradient is left unclipped; the ops below clip their own.
+static void reduce_backward(Tensor& self, float scale) {
+    Tensor* in = self.left.get();
+    bool all_rows = self.rows == 1;
+    bool all_cols = self.cols == 1;
+    parallel_for(0, in->rows, rows_per_chunk(in->cols), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const float* g = self.grad[all_rows ? 0 : i];
+            float* dst = in->grad[i];
+            for (int j = 0; j < in->cols; j++) {
+                dst[j] += g[all_cols ? 0 : j] * scale;
+            }
+        }
+    });
+}
+
+Tensor Tensor::sum(int axis) const {
+    check_axis(axis);
+    AllocSiteScope site("sum");
+    ProfileScope prof("sum", 1.0 * rows * cols, sizeof(float32) * (1.0 * rows * cols));
+    Tensor result(axis == 1 ? rows : 1, axis == 0 ? cols : 1);
+    prof.shapes(result.rows, result.cols, rows, cols);
+    result.link(this);
+    result.name = "sum(" + this->name + ")";
+    reduce_into(*this, result, axis, 1.0f);
+    result._backward = &Tensor::backsum;
+    return result;
+}
+
+Tensor Tensor::mean(int axis) const {
+    check_axis(axis);
+    AllocSiteScope site("mean");
+    ProfileScope prof("mean", 1.0 * rows * cols, sizeof(float32) * (1.0 * rows * cols));
+    Tensor result(axis == 1 ? rows : 1, axis == 0 ? cols : 1);
+    prof.shapes(result.rows, result.cols, rows, cols);
+    result.link(this);
+    result.name = "mean(" + this->name + ")";
+    float count = axis == -1 ? static_cast<float>(rows) * cols : axis == 0 ? rows : cols;
+    reduce_into(*this, result, axis, 1.0f / count);
+    result._backward = &Tensor::backmean;
+    return result;
+}
+
+void Tensor::backsum() {
+    ProfileScope prof("backsum", 1.0 * left->rows * left->cols, 2.0 * sizeof(float32) * left->rows * left->cols);
+    prof.shapes(rows, cols, left->rows, left->cols);
+    reduce_backward(*this, 1.0f);
+}
+
+void Tensor::backmean() {
+    ProfileScope prof("backmean", 2.0 * left->rows * left->cols, 2.0 * sizeof(float32) * left->rows * left->cols);
+    prof.shapes(rows, cols, left->rows, left->cols);
+    float count = static_cast<float>(left->rows) * left->cols / (static_cast<float>(rows) * cols);
+    reduce_backward(*this, 1.0f / count);
+}
+
+Tensor Tensor::mse(const Tensor& target) const {
+    if (this->rows != target.rows || this->cols != target.cols) {
+        throw std::invalid_argument("Prediction and target must have the same shape");
+    }
+    AllocSiteScope site("mse");
+    ProfileScope prof("mse", 3.0 * rows * cols, 2.0 * sizeof(float32) * rows * cols);
+    prof.shapes(1, 1, rows, cols, target.rows, target.cols);
+    Tensor result(1, 1);
+    result.link(this, &target);
+    result.name = "mse(" + this->name + "," + target.name + ")";
+    double total = parallel_reduce(0, rows, rows_per_chunk(cols), [&](int begin, int end) {
+        double acc = 0.0;
+        for (int i = begin; i < end; i++) {
+            const float* p = this->data[i];
+            const float* t = target.data[i];
+            for (int j = 0; j < cols; j++) {
+                float diff = p[j] - t[j];
+                acc += diff * diff;
+            }
+        }
+        return acc;
+    });
+    result.data[0][0] = static_cast<float>(total / (static_cast<double>(rows) * cols));
+    result._backward = &Tensor::backmse;
+    return result;
+}
+
+void Tensor::backmse() {
+    int n_rows = left->rows;
+    int n_cols = left->cols;
+    ProfileScope prof("backmse", 3.0 * n_rows * n_cols, 3.0 * sizeof(float32) * n_rows * n_cols);
+    prof.shapes(rows, cols, n_rows, n_cols, n_rows, n_cols);
+    float scale = 2.0f * this->grad[0][0] / (static_cast<float>(n_rows) * n_cols);
+    parallel_for(0, n_rows, rows_per_chunk(n_cols), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const float* p = left->data[i];
+            const float* t = right->data[i];
+            float* g = left->grad[i];
+            for (int j = 0; j < n_cols; j++) {
+                g[j] += scale * (p[j] - t[j]);
+            }
+        }
+    });
+}
+
+// Per-row log-sum-exp with the usual max shift.
+static float row_logsumexp(const float* x, int n) {
+    float m = x[0];
+    for (int j = 1; j < n; j++) {
+        m = std::max(m, x[j]);
+    }
+    float s = 0.0f;
+    for (int j = 0; j < n; j++) {
+        s += std::exp(x[j] - m);
+    }
+    return m + std::log(s);
+}
+
+Tensor Tensor::cross_entropy(const Tensor& target) const {
+    if (this->rows != target.rows || this->cols != target.cols) {
+        throw std::invalid_argument("Logits and target must have the same shape");
+    }
+    AllocSiteScope site("cross_entropy");
+    ProfileScope prof("cross_entropy", 6.0 * rows * cols, 2.0 * sizeof(float32) * rows * cols);
+    prof.shapes(1, 1, rows, cols, target.rows, target.cols);
+    Tensor result(1, 1);
+    result.link(this, &target);
+    result.name = "cross_entropy(" + this->name + "," + target.name + ")";
+    double total = parallel_reduce(0, rows, rows_per_chunk(cols), [&](int begin, int end) {
+        double acc = 0.0;
+        for (int i = begin; i < end; i++) {
+            const float* x = this->data[i];
+            const float* t = target.data[i];
+            float lse = row_logsumexp(x, cols);
+            for (int j = 0; j < cols; j++) {
+                acc -= t[j] * (x[j] - lse);
+            }
+        }
+        return acc;
+    });
+    result.data[0][0] = static_cast<float>(total / rows);
+    result._backward = &Tensor::backcrossentropy;
+    return result;
+}
+
+void Tensor::backcrossentropy() {
+    int n_rows = left->rows;
+    int n_cols = left->cols;
+    ProfileScope prof("backcrossentropy", 6.0 * n_rows * n_cols, 3.0 * sizeof(float32) * n_rows * n_cols);
+    prof.shapes(rows, cols, n_rows, n_cols, n_rows, n_cols);
+    float scale = this->grad[0][0] / n_rows;
+    // d/dx_j = softmax_j * sum(t) - t_j, recomputed here instead of kept from forward.
+    parallel_for(0, n_rows, rows_per_chunk(n_cols), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const float* x = left->data[i];
+            const float* t = right->data[i];
+            float* g = left->grad[i];
+            float lse = row_logsumexp(x, n_cols);
+            float t_sum = 0.0f;
+            for (int j = 0; j < n_cols; j++) {
+                t_sum += t[j];
+            }
+            for (int j = 0; j < n_cols; j++) {
+                g[j] += scale * (std::exp(x[j] - lse) * t_sum - t[j]);
+            }
+        }
+    });
+}
+
 void visit_tensor(const boost::intrusive_ptr<Tensor>& t,
                  std::set<boost::intrusive_ptr<Tensor>>& visited,
                  std::vector<boost::intrusive_ptr<Tensor>>& topo) {
@@ -289,27 +642,69 @@ void visit_tensor(const boost::intrusive_ptr<Tensor>& t,
     if (t->right) {
         visit_tensor(t->right, visited, topo);
     }
+    for (const auto& input : t->extra_inputs) {
+        visit_tensor(input, visited, topo);
+    }
     
     topo.push_back(t);
 }
 
 void Tensor::backward() {
+    // A scalar sum/mean/loss root with no incoming gradient seeds dL/dL = 1;
+    // any other root propagates the gradient the caller wrote, as before.
+    bool loss_root = _backward == &Tensor::backsum || _backward == &Tensor::backmean ||
+                     _backward == &Tensor::backmse || _backward == &Tensor::backcrossentropy;
+    if (loss_root && rows == 1 && cols == 1 && grad[0][0] == 0.0f) {
+        grad[0][0] = 1.0f;
+    }
+    propagate();
+}
+
+void Tensor::backward(float seed) {
+    if (rows != 1 || cols != 1) {
+        throw std::invalid_argument("backward(seed) needs a 1x1 root");
+    }
+    grad[0][0] = seed;
+    propagate();
+}
+
+void Tensor::backcontext() {
+    if (ctx) {
+        ctx->backward(*this);
+    }
+}
+
+static GradReadyHook& grad_ready_hook() {
+    thread_local GradReadyHook hook;
+    return hook;
+}
+
+void set_grad_ready_hook(GradReadyHook hook) {
+    grad_ready_hook() = std::move(hook);
+}
+
+void Tensor::propagate() {
+    ProfileScope prof("backward");
+    prof.shapes(rows, cols);
     std::vector<boost::intrusive_ptr<Tensor>> topo;
     std::set<boost::intrusive_ptr<Tensor>> visited;
     
     auto self = boost::intrusive_ptr<Tensor>(this);
     visit_tensor(self, visited, topo);
+    const GradReadyHook& hook = grad_ready_hook();
 
     for (int i = topo.size() - 1; i >= 0; i--) {
         if (topo[i]->_backward) {
             (topo[i].get()->*(topo[i]->_backward))();
+        } else if (hook) {
+            // Every consumer of a leaf comes later in topo order, so its
+            // gradient is complete by the time the loop reaches it.
+            hook(*topo[i]);
         }
         // Free left and right child tensors after computation
     }
-    for(int i = 0;i<topo.size();i++){
-        topo[i]->left = nullptr;
-        topo[i]->right = nullptr;
-        topo[i]->_backward = nullptr;
+    for(size_t i = 0;i<topo.size();i++){
+        topo[i]->unlink();
     }
 }
 
@@ -0,0 +1,230 @@
+#include "memory_stats.h"
+#include "alloc_policy.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+
+struct MemSite {
+    std::string name;
+    std::atomic<size_t> live_bytes[static_cast<int>(MemCategory::Count)] = {};
+    std::atomic<size_t> peak_bytes[static_cast<int>(MemCategory::Count)] = {};
+    std::atomic<long> live_allocations[static_cast<int>(MemCategory::Count)] = {};
+
+    explicit MemSite(const char* name) : name(name) {}
+};
+
+namespace {
+
+constexpr int NUM_CATEGORIES = static_cast<int>(MemCategory::Count);
+constexpr size_t SITE_CACHE = 64;
+
+struct State {
+    std::atomic<size_t> live[NUM_CATEGORIES] = {};
+    std::atomic<size_t> peak[NUM_CATEGORIES] = {};
+    std::atomic<size_t> live_total{0};
+    std::atomic<size_t> peak_total{0};
+    std::atomic<long> graph_nodes{0};
+    std::mutex site_mutex;         // guards interning and the list, not the counters
+    std::deque<MemSite> sites;     // stable addresses
+};
+
+State& state() {
+    static State* s = new State();  // leaked on purpose, tensors may die after exit handlers
+    return *s;
+}
+
+void raise_peak(std::atomic<size_t>& peak, size_t value) {
+    size_t current = peak.load(std::memory_order_relaxed);
+    while (value > current &&
+           !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+// Per-thread direct-mapped cache from literal address to interned site.
+MemSite* cached_site(const char* name) {
+    struct Cached {
+        const char* name = nullptr;
+        MemSite* site = nullptr;
+    };
+    thread_local Cached cache[SITE_CACHE];
+    Cached& c = cache[(reinterpret_cast<uintptr_t>(name) >> 3) % SITE_CACHE];
+    if (c.name != name) {
+        c.site = MemoryStats::site(name);
+        c.name = name;
+    }
+    return c.site;
+}
+
+void dump_at_exit() {
+    MemoryStats::report(std::cout);
+}
+
+// Honour ESP_MEMSTATS before main() runs.
+struct EnvInit {
+    EnvInit() {
+        const char* flag = std::getenv("ESP_MEMSTATS");
+        if (flag && *flag && strcmp(flag, "0") != 0) {
+            std::atexit(dump_at_exit);
+        }
+    }
+} env_init;
+
+}  // namespace
+
+const char* category_name(MemCategory category) {
+    switch (category) {
+        case MemCategory::Parameter: return "parameter";
+        case MemCategory::Activation: return "activation";
+        case MemCategory::Gradient: return "gradient";
+        case MemCategory::Workspace: return "workspace";
+        default: return "unknown";
+    }
+}
+
+// Sites are string literals; identical text from different translation
+// units may live at different addresses, so match by text here, once.
+MemSite* MemoryStats::site(const char* name) {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.site_mutex);
+    for (MemSite& e : s.sites) {
+        if (e.name == name) {
+            return &e;
+        }
+    }
+    s.sites.emplace_back(name);
+    return &s.sites.back();
+}
+
+MemSite* AllocSiteScope::resolve(const char* name) {
+    return cached_site(name);
+}
+
+void MemoryStats::allocate(MemCategory category, MemSite* site, size_t bytes) {
+    State& s = state();
+    int c = static_cast<int>(category);
+    raise_peak(s.peak[c], s.live[c].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    raise_peak(s.peak_total, s.live_total.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    raise_peak(site->peak_bytes[c], site->live_bytes[c].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    site->live_allocations[c].fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryStats::release(MemCategory category, MemSite* site, size_t bytes) {
+    State& s = state();
+    int c = static_cast<int>(category);
+    s.live[c].fetch_sub(bytes, std::memory_order_relaxed);
+    s.live_total.fetch_sub(bytes, std::memory_order_relaxed);
+    site->live_bytes[c].fetch_sub(bytes, std::memory_order_relaxed);
+    site->live_allocations[c].fetch_sub(1, std::memory_order_relaxed);
+}
+
+void MemoryStats::allocate(MemCategory category, const char* site, size_t bytes) {
+    allocate(category, cached_site(site), bytes);
+}
+
+void MemoryStats::release(MemCategory category, const char* site, size_t bytes) {
+    release(category, cached_site(site), bytes);
+}
+
+size_t MemoryStats::live(MemCategory category) {
+    return state().live[static_cast<int>(category)].load(std::memory_order_relaxed);
+}
+
+size_t MemoryStats::peak(MemCategory category) {
+    return state().peak[static_cast<int>(category)].load(std::memory_order_relaxed);
+}
+
+size_t MemoryStats::liveTotal() {
+    return state().live_total.load(std::memory_order_relaxed);
+}
+
+size_t MemoryStats::peakTotal() {
+    return state().peak_total.load(std::memory_order_relaxed);
+}
+
+std::vector<SiteUsage> MemoryStats::sites() {
+    State& s = state();
+    std::vector<SiteUsage> out;
+    {
+        std::lock_guard<std::mutex> lock(s.site_mutex);
+        for (const MemSite& e : s.sites) {
+            for (int c = 0; c < NUM_CATEGORIES; c++) {
+                size_t peak = e.peak_bytes[c].load(std::memory_order_relaxed);
+                long allocations = e.live_allocations[c].load(std::memory_order_relaxed);
+                if (peak == 0 && allocations == 0) {
+                    continue;
+                }
+                out.push_back(SiteUsage{e.name, static_cast<MemCategory>(c),
+                                        e.live_bytes[c].load(std::memory_order_relaxed), peak, allocations});
+            }
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const SiteUsage& a, const SiteUsage& b) {
+        return a.live_bytes > b.live_bytes;
+    });
+    return out;
+}
+
+void MemoryStats::resetPeak() {
+    State& s = state();
+    for (int c = 0; c < NUM_CATEGORIES; c++) {
+        s.peak[c].store(s.live[c].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    s.peak_total.store(s.live_total.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(s.site_mutex);
+    for (MemSite& e : s.sites) {
+        for (int c = 0; c < NUM_CATEGORIES; c++) {
+            e.peak_bytes[c].store(e.live_bytes[c].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+    }
+}
+
+void MemoryStats::graphNodeCreated() {
+    state().graph_nodes.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryStats::graphNodeReleased() {
+    state().graph_nodes.fetch_sub(1, std::memory_order_relaxed);
+}
+
+long MemoryStats::liveGraphNodes() {
+    return state().graph_nodes.load(std::memory_order_relaxed);
+}
+
+void MemoryStats::report(std::ostream& os) {
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(1);
+    os << "Tensor memory (KB)\n";
+    os << std::left << std::setw(14) << "category"
+       << std::right << std::setw(14) << "live" << std::setw(14) << "peak" << "\n";
+    for (int c = 0; c < NUM_CATEGORIES; c++) {
+        MemCategory category = static_cast<MemCategory>(c);
+        os << std::left << std::setw(14) << category_name(category)
+           << std::right << std::setw(14) << live(category) / 1024.0
+           << std::setw(14) << peak(category) / 1024.0 << "\n";
+    }
+    os << std::left << std::setw(14) << "total"
+       << std::right << std::setw(14) << liveTotal() / 1024.0
+       << std::setw(14) << peakTotal() / 1024.0 << "\n";
+
+    os << "By allocation site\n";
+    for (const SiteUsage& u : sites()) {
+        os << "  " << std::left << std::setw(18) << u.site << std::setw(12) << category_name(u.category)
+           << std::right << std::setw(12) << u.live_bytes / 1024.0 << " live"
+           << std::setw(12) << u.peak_bytes / 1024.0 << " peak"
+           << std::setw(8) << u.live_allocations << " buffers\n";
+    }
+
+    long nodes = liveGraphNodes();
+    os << "Unreleased graph nodes: " << nodes;
+    if (nodes > 0) {
+        os << " (graphs kept alive without backward())";
+    }
+    os << std::endl;
+    AllocPolicy::report(os);
+    os.unsetf(std::ios::fixed);
+    os.precision(precision);
+}
@@ -0,0 +1,219 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<bool>& pin_flag() {
+    static std::atomic<bool> flag{[] {
+        const char* env = std::getenv("ESP_PIN_THREADS");
+        return env && *env && std::strcmp(env, "0") != 0;
+    }()};
+    return flag;
+}
+
+// Pin `t` to the index-th CPU of the process affinity mask, wrapping around.
+void pin(std::thread& t, int index) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return;
+    }
+    int target = index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            pthread_setaffinity_np(t.native_handle(), sizeof(one), &one);
+            return;
+        }
+    }
+}
+
+// Fixed pool of num_threads() - 1 workers. One job runs at a time; nested
+// parallel_for calls from inside a job run inline.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int)>* job = nullptr;
+    int job_chunks = 0;
+    int next_chunk = 0;
+    int pending = 0;
+    long generation = 0;
+    bool stopping = false;
+    std::mutex submit_mutex;
+
+    void run_chunks(std::unique_lock<std::mutex>& lock) {
+        while (next_chunk < job_chunks) {
+            int chunk = next_chunk++;
+            const std::function<void(int)>* fn = job;
+            lock.unlock();
+            (*fn)(chunk);
+            lock.lock();
+            if (--pending == 0) {
+                done.notify_all();
+            }
+        }
+    }
+
+    void worker_loop() {
+        long seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            in_pool() = true;
+            run_chunks(lock);
+            in_pool() = false;
+        }
+    }
+
+public:
+    explicit ThreadPool(int threads) {
+        for (int i = 1; i < threads; i++) {
+            workers.emplace_back([this] { worker_loop(); });
+            if (pin_flag().load()) {
+                pin(workers.back(), i);
+            }
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+
+    static bool& in_pool() {
+        thread_local bool flag = false;
+        return flag;
+    }
+
+    int size() const {
+        return static_cast<int>(workers.size()) + 1;
+    }
+
+    void run(int chunks, const std::function<void(int)>& fn) {
+        std::lock_guard<std::mutex> submit(submit_mutex);
+        std::unique_lock<std::mutex> lock(mutex);
+        job = &fn;
+        job_chunks = chunks;
+        next_chunk = 0;
+        pending = chunks;
+        generation++;
+        wake.notify_all();
+        in_pool() = true;
+        run_chunks(lock);
+        in_pool() = false;
+        done.wait(lock, [&] { return pending == 0; });
+        job = nullptr;
+    }
+};
+
+ThreadPool& pool() {
+    static ThreadPool p(num_threads());
+    return p;
+}
+
+std::atomic<bool> inline_only{false};
+
+bool& thread_inline() {
+    thread_local bool flag = false;
+    return flag;
+}
+
+int chunk_count(int n, int min_chunk) {
+    if (min_chunk < 1) {
+        min_chunk = 1;
+    }
+    if (n < 2 * min_chunk || ThreadPool::in_pool() || thread_inline() || inline_only.load(std::memory_order_relaxed)) {
+        return 1;
+    }
+    return std::min(num_threads(), n / min_chunk);
+}
+
+}  // namespace
+
+int num_threads() {
+    static const int threads = [] {
+        const char* env = std::getenv("ESP_NUM_THREADS");
+        int n = env ? std::atoi(env) : 0;
+        if (n <= 0) {
+            n = static_cast<int>(std::thread::hardware_concurrency());
+        }
+        return std::max(1, n);
+    }();
+    return threads;
+}
+
+void set_parallel_inline(bool on) {
+    inline_only.store(on, std::memory_order_relaxed);
+}
+
+void set_pin_threads(bool on) {
+    pin_flag().store(on);
+}
+
+bool pin_threads() {
+    return pin_flag().load();
+}
+
+void set_thread_inline(bool on) {
+    thread_inline() = on;
+}
+
+void parallel_for(int begin, int end, int min_chunk, const std::function<void(int, int)>& fn) {
+    int n = end - begin;
+    if (n <= 0) {
+        return;
+    }
+    int chunks = chunk_count(n, min_chunk);
+    if (chunks == 1) {
+        fn(begin, end);
+        return;
+    }
+    pool().run(chunks, [&](int c) {
+        fn(begin + static_cast<int>(static_cast<long>(n) * c / chunks),
+           begin + static_cast<int>(static_cast<long>(n) * (c + 1) / chunks));
+    });
+}
+
+double parallel_reduce(int begin, int end, int min_chunk, const std::function<double(int, int)>& fn) {
+    int n = end - begin;
+    if (n <= 0) {
+        return 0.0;
+    }
+    int chunks = chunk_count(n, min_chunk);
+    if (chunks == 1) {
+        return fn(begin, end);
+    }
+    std::vector<double> partial(chunks, 0.0);
+    pool().run(chunks, [&](int c) {
+        partial[c] = fn(begin + static_cast<int>(static_cast<long>(n) * c / chunks),
+                        begin + static_cast<int>(static_cast<long>(n) * (c + 1) / chunks));
+    });
+    double total = 0.0;
+    for (double p : partial) {
+        total += p;
+    }
+    return total;
+}
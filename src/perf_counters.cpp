@@ -0,0 +1,334 @@
+#include "perf_counters.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr int N = CounterValues::N;
+
+struct CounterConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+const CounterConfig COUNTER_CONFIGS[N] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+int open_counter(const CounterConfig& c, int group_fd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = c.type;
+    attr.config = c.config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = group_fd < 0;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+struct Totals {
+    long calls = 0;
+    int64_t ns = 0;
+    double flops = 0.0;
+    double bytes = 0.0;
+    uint64_t value[N] = {};
+    bool valid[N] = {};
+};
+
+// Per-thread tables keyed by label, merged by name when printed.
+struct LocalTable {
+    std::mutex mutex;
+    std::map<const char*, Totals> rows;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<LocalTable>> tables;
+    // Outcome of the first thread that tried to open counters.
+    bool opened = false;
+    bool available = false;
+    std::string reason;
+};
+
+Registry& registry() {
+    static Registry* r = new Registry();  // leaked on purpose, outlives thread_locals
+    return *r;
+}
+
+// One counter group per thread; members are read together with one read().
+struct ThreadCounters {
+    int leader = -1;
+    std::vector<int> fds;
+    std::vector<int> slots;  // counter index of each group member, in read order
+    std::string reason;
+
+    ThreadCounters() {
+        for (int c = 0; c < N; c++) {
+            int fd = open_counter(COUNTER_CONFIGS[c], leader);
+            if (fd < 0) {
+                if (reason.empty()) {
+                    reason = std::string("perf_event_open(") + counter_name(static_cast<PerfCounter>(c)) +
+                             "): " + std::strerror(errno);
+                }
+                continue;
+            }
+            if (leader < 0) {
+                leader = fd;
+            }
+            fds.push_back(fd);
+            slots.push_back(c);
+        }
+        if (leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        if (!reg.opened) {
+            reg.opened = true;
+            reg.available = leader >= 0;
+            reg.reason = reason;
+        }
+    }
+
+    ~ThreadCounters() {
+        for (int fd : fds) {
+            close(fd);
+        }
+    }
+
+    void read(CounterValues& out) const {
+        out = CounterValues();
+        if (leader < 0) {
+            return;
+        }
+        uint64_t buf[1 + N];
+        if (::read(leader, buf, sizeof(buf)) < static_cast<ssize_t>(sizeof(uint64_t))) {
+            return;
+        }
+        for (uint64_t k = 0; k < buf[0] && k < slots.size(); k++) {
+            out.value[slots[k]] = buf[1 + k];
+            out.valid[slots[k]] = true;
+        }
+    }
+};
+
+ThreadCounters& local_counters() {
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+LocalTable& local_table() {
+    thread_local std::shared_ptr<LocalTable> table;
+    if (!table) {
+        table = std::make_shared<LocalTable>();
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.tables.push_back(table);
+    }
+    return *table;
+}
+
+// Registry after some thread has tried to open counters. Only opens them
+// here if none has, since at exit this thread's counters may be gone.
+Registry& probe() {
+    Registry& reg = registry();
+    bool opened;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        opened = reg.opened;
+    }
+    if (!opened) {
+        local_counters();
+    }
+    return reg;
+}
+
+std::string paranoid_level() {
+    std::ifstream in("/proc/sys/kernel/perf_event_paranoid");
+    std::string level;
+    return in >> level ? level : "?";
+}
+
+void dump_at_exit() {
+    PerfCounters::printSummary();
+}
+
+// Honour ESP_PERF_COUNTERS before main() runs.
+struct EnvInit {
+    EnvInit() {
+        const char* flag = std::getenv("ESP_PERF_COUNTERS");
+        if (flag && *flag && std::strcmp(flag, "0") != 0) {
+            PerfCounters::enable();
+            std::atexit(dump_at_exit);
+        }
+    }
+} env_init;
+
+}  // namespace
+
+const char* counter_name(PerfCounter counter) {
+    switch (counter) {
+        case PerfCounter::Cycles: return "cycles";
+        case PerfCounter::Instructions: return "instructions";
+        case PerfCounter::LLCMisses: return "llc-misses";
+        case PerfCounter::BranchMisses: return "branch-misses";
+        default: return "unknown";
+    }
+}
+
+bool PerfCounters::available() {
+    Registry& reg = probe();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    return reg.available;
+}
+
+std::string PerfCounters::unavailableReason() {
+    Registry& reg = probe();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (reg.available) {
+        return "";
+    }
+    return reg.reason + " (perf_event_paranoid=" + paranoid_level() + ")";
+}
+
+void PerfCounters::read(CounterValues& out) {
+    local_counters().read(out);
+}
+
+void PerfCounters::record(const char* label, const CounterValues& start, const CounterValues& end,
+                          int64_t ns, double flops, double bytes) {
+    LocalTable& table = local_table();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    Totals& t = table.rows[label];
+    t.calls++;
+    t.ns += ns;
+    t.flops += flops;
+    t.bytes += bytes;
+    for (int c = 0; c < N; c++) {
+        if (start.valid[c] && end.valid[c]) {
+            t.value[c] += end.value[c] - start.value[c];
+            t.valid[c] = true;
+        }
+    }
+}
+
+void PerfCounters::reset() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& table : reg.tables) {
+        std::lock_guard<std::mutex> table_lock(table->mutex);
+        table->rows.clear();
+    }
+}
+
+void PerfCounters::printSummary(std::ostream& os) {
+    std::map<std::string, Totals> merged;
+    {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (const auto& table : reg.tables) {
+            std::lock_guard<std::mutex> table_lock(table->mutex);
+            for (const auto& row : table->rows) {
+                Totals& m = merged[row.first];
+                const Totals& t = row.second;
+                m.calls += t.calls;
+                m.ns += t.ns;
+                m.flops += t.flops;
+                m.bytes += t.bytes;
+                for (int c = 0; c < N; c++) {
+                    m.value[c] += t.value[c];
+                    m.valid[c] = m.valid[c] || t.valid[c];
+                }
+            }
+        }
+    }
+    std::vector<std::pair<std::string, Totals>> rows(merged.begin(), merged.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.ns > b.second.ns;
+    });
+
+    if (!available()) {
+        os << "Hardware counters unavailable: " << unavailableReason() << "\n";
+    }
+    auto has = [](const Totals& t, PerfCounter c) { return t.valid[static_cast<int>(c)]; };
+    auto get = [](const Totals& t, PerfCounter c) { return static_cast<double>(t.value[static_cast<int>(c)]); };
+    auto cell = [&os](bool ok, double v, int width, int precision) {
+        if (ok) {
+            os << std::setw(width) << std::setprecision(precision) << v;
+        } else {
+            os << std::setw(width) << "n/a";
+        }
+    };
+
+    // MPKI = misses per thousand instructions.
+    std::streamsize precision = os.precision();
+    os << std::left << std::setw(20) << "op"
+       << std::right << std::setw(10) << "calls"
+       << std::setw(12) << "total(ms)"
+       << std::setw(12) << "Mcycles"
+       << std::setw(8) << "IPC"
+       << std::setw(10) << "GFLOP/s"
+       << std::setw(10) << "B/FLOP"
+       << std::setw(10) << "LLC MPKI"
+       << std::setw(10) << "br MPKI" << "\n";
+    os << std::fixed;
+    for (const auto& row : rows) {
+        const Totals& t = row.second;
+        double secs = t.ns / 1e9;
+        double kinstr = get(t, PerfCounter::Instructions) / 1000.0;
+        bool instr = has(t, PerfCounter::Instructions) && kinstr > 0;
+        os << std::left << std::setw(20) << row.first
+           << std::right << std::setw(10) << t.calls
+           << std::setw(12) << std::setprecision(3) << t.ns / 1e6;
+        cell(has(t, PerfCounter::Cycles), get(t, PerfCounter::Cycles) / 1e6, 12, 2);
+        cell(instr && has(t, PerfCounter::Cycles) && get(t, PerfCounter::Cycles) > 0,
+             get(t, PerfCounter::Instructions) / get(t, PerfCounter::Cycles), 8, 2);
+        cell(secs > 0 && t.flops > 0, t.flops / secs / 1e9, 10, 3);
+        cell(t.flops > 0, t.bytes / t.flops, 10, 2);
+        cell(instr && has(t, PerfCounter::LLCMisses), get(t, PerfCounter::LLCMisses) / kinstr, 10, 3);
+        cell(instr && has(t, PerfCounter::BranchMisses), get(t, PerfCounter::BranchMisses) / kinstr, 10, 3);
+        os << "\n";
+    }
+    os.unsetf(std::ios::fixed);
+    os.precision(precision);
+}
+
+CounterScope::CounterScope(const char* label, double flops, double bytes)
+    : label(label), flops(flops), bytes(bytes), active(PerfCounters::enabled()) {
+    if (!active) {
+        return;
+    }
+    parent = innermost();
+    innermost() = this;
+    start_ns = Profiler::now_ns();
+    PerfCounters::read(start);
+}
+
+CounterScope::~CounterScope() {
+    if (!active) {
+        return;
+    }
+    CounterValues end;
+    PerfCounters::read(end);
+    innermost() = parent;
+    PerfCounters::record(label, start, end, Profiler::now_ns() - start_ns, flops, bytes);
+}
@@ -0,0 +1,227 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Single-producer ring: only the owning thread writes, exporters read.
+struct EventRing {
+    std::unique_ptr<ProfileEvent[]> events{new ProfileEvent[Profiler::RING_CAPACITY]};
+    std::atomic<uint64_t> head{0};
+    uint32_t tid = 0;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<EventRing>> rings;
+};
+
+Registry& registry() {
+    static Registry* r = new Registry();  // leaked on purpose, outlives thread_locals
+    return *r;
+}
+
+EventRing& local_ring() {
+    thread_local std::shared_ptr<EventRing> ring;
+    if (!ring) {
+        ring = std::make_shared<EventRing>();
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        ring->tid = static_cast<uint32_t>(reg.rings.size());
+        reg.rings.push_back(ring);
+    }
+    return *ring;
+}
+
+std::vector<ProfileEvent> collect_events() {
+    std::vector<ProfileEvent> out;
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& ring : reg.rings) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t count = std::min<uint64_t>(head, Profiler::RING_CAPACITY);
+        for (uint64_t i = head - count; i < head; i++) {
+            out.push_back(ring->events[i & (Profiler::RING_CAPACITY - 1)]);
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const ProfileEvent& a, const ProfileEvent& b) {
+        return a.start_ns < b.start_ns;
+    });
+    return out;
+}
+
+// Time of each event minus the events nested directly inside it on the
+// same thread (clip_gradient in backmul, backmul in backward). Self times
+// never overlap, so they add up to the top-level wall time per thread.
+std::vector<int64_t> self_times(const std::vector<ProfileEvent>& events) {
+    std::vector<size_t> order(events.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        const ProfileEvent& x = events[a];
+        const ProfileEvent& y = events[b];
+        if (x.tid != y.tid) return x.tid < y.tid;
+        if (x.start_ns != y.start_ns) return x.start_ns < y.start_ns;
+        return x.end_ns > y.end_ns;  // parents before children starting with them
+    });
+    std::vector<int64_t> self(events.size());
+    std::vector<size_t> open;
+    for (size_t k = 0; k < order.size(); k++) {
+        const ProfileEvent& ev = events[order[k]];
+        self[order[k]] = ev.end_ns - ev.start_ns;
+        if (k > 0 && events[order[k - 1]].tid != ev.tid) {
+            open.clear();
+        }
+        while (!open.empty() && events[open.back()].end_ns <= ev.start_ns) {
+            open.pop_back();
+        }
+        if (!open.empty()) {
+            self[open.back()] -= ev.end_ns - ev.start_ns;
+        }
+        open.push_back(order[k]);
+    }
+    return self;
+}
+
+std::string shape_string(const ProfileEvent& ev) {
+    std::string s;
+    if (ev.lhs_shape[0] || ev.lhs_shape[1]) {
+        s += std::to_string(ev.lhs_shape[0]) + "x" + std::to_string(ev.lhs_shape[1]);
+    }
+    if (ev.rhs_shape[0] || ev.rhs_shape[1]) {
+        s += ", " + std::to_string(ev.rhs_shape[0]) + "x" + std::to_string(ev.rhs_shape[1]);
+    }
+    s += " -> " + std::to_string(ev.out_shape[0]) + "x" + std::to_string(ev.out_shape[1]);
+    return s;
+}
+
+std::string profile_path() {
+    const char* path = std::getenv("ESP_PROFILE");
+    return path ? std::string(path) : std::string();
+}
+
+void dump_at_exit() {
+    std::string path = profile_path();
+    if (Profiler::writeChromeTrace(path)) {
+        std::cout << "Profiler trace written to " << path << std::endl;
+    }
+    Profiler::printSummary();
+}
+
+// Honour ESP_PROFILE before main() runs.
+struct EnvInit {
+    EnvInit() {
+        if (!profile_path().empty()) {
+            Profiler::enable();
+            std::atexit(dump_at_exit);
+        }
+    }
+} env_init;
+
+}  // namespace
+
+void Profiler::record(const ProfileEvent& ev) {
+    EventRing& ring = local_ring();
+    uint64_t idx = ring.head.load(std::memory_order_relaxed);
+    ProfileEvent& slot = ring.events[idx & (RING_CAPACITY - 1)];
+    slot = ev;
+    slot.tid = ring.tid;
+    ring.head.store(idx + 1, std::memory_order_release);
+}
+
+void Profiler::reset() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& ring : reg.rings) {
+        ring->head.store(0, std::memory_order_release);
+    }
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    std::vector<ProfileEvent> events = collect_events();
+    int64_t origin = events.empty() ? 0 : events.front().start_ns;
+
+    out << "{\"traceEvents\":[\n";
+    out << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < events.size(); i++) {
+        const ProfileEvent& ev = events[i];
+        out << "{\"name\":\"" << ev.op << "\",\"cat\":\"tensor\",\"ph\":\"X\""
+            << ",\"ts\":" << (ev.start_ns - origin) / 1000.0
+            << ",\"dur\":" << (ev.end_ns - ev.start_ns) / 1000.0
+            << ",\"pid\":1,\"tid\":" << ev.tid
+            << ",\"args\":{\"shape\":\"" << shape_string(ev) << "\""
+            << ",\"flops\":" << ev.flops
+            << ",\"bytes\":" << ev.bytes << "}}";
+        out << (i + 1 < events.size() ? ",\n" : "\n");
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(out);
+}
+
+void Profiler::printSummary(std::ostream& os) {
+    struct Totals {
+        long calls = 0;
+        int64_t ns = 0;
+        int64_t self_ns = 0;
+        double flops = 0.0;
+        double bytes = 0.0;
+    };
+    std::vector<ProfileEvent> events = collect_events();
+    std::vector<int64_t> self = self_times(events);
+    std::map<std::string, Totals> per_op;
+    int64_t total_self_ns = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        const ProfileEvent& ev = events[i];
+        Totals& t = per_op[ev.op];
+        t.calls++;
+        t.ns += ev.end_ns - ev.start_ns;
+        t.self_ns += self[i];
+        t.flops += ev.flops;
+        t.bytes += ev.bytes;
+        total_self_ns += self[i];
+    }
+
+    std::vector<std::pair<std::string, Totals>> rows(per_op.begin(), per_op.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.ns > b.second.ns;
+    });
+
+    // total is inclusive of nested ops; self and share exclude them, so
+    // shares add up to 100%.
+    std::streamsize precision = os.precision();
+    os << std::left << std::setw(20) << "op"
+       << std::right << std::setw(10) << "calls"
+       << std::setw(14) << "total(ms)"
+       << std::setw(12) << "self(ms)"
+       << std::setw(12) << "avg(us)"
+       << std::setw(9) << "share"
+       << std::setw(12) << "GFLOP/s"
+       << std::setw(12) << "GB/s" << "\n";
+    os << std::fixed;
+    for (const auto& row : rows) {
+        const Totals& t = row.second;
+        double secs = t.ns / 1e9;
+        os << std::left << std::setw(20) << row.first
+           << std::right << std::setw(10) << t.calls
+           << std::setw(14) << std::setprecision(3) << t.ns / 1e6
+           << std::setw(12) << std::setprecision(3) << t.self_ns / 1e6
+           << std::setw(12) << std::setprecision(2) << t.ns / 1e3 / t.calls
+           << std::setw(8) << std::setprecision(1) << (total_self_ns ? 100.0 * t.self_ns / total_self_ns : 0.0) << "%"
+           << std::setw(12) << std::setprecision(3) << (secs > 0 ? t.flops / secs / 1e9 : 0.0)
+           << std::setw(12) << std::setprecision(3) << (secs > 0 ? t.bytes / secs / 1e9 : 0.0)
+           << "\n";
+    }
+    os.unsetf(std::ios::fixed);
+    os.precision(precision);
+}
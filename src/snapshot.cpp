@@ -0,0 +1,338 @@
+#include "snapshot.h"
+#include "memory_stats.h"
+#include "profiler.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+const char MAGIC[8] = {'E', 'S', 'P', 'S', 'N', 'A', 'P', '1'};
+const uint32_t VERSION = 1;
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+std::runtime_error io_error(const std::string &what, const std::string &path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+// Sequential writer that checksums everything and reports progress.
+class FileWriter {
+private:
+    int fd;
+    const std::string &path;
+    std::atomic<size_t> &progress;
+
+public:
+    uint64_t hash = FNV_OFFSET;
+
+    FileWriter(int fd, const std::string &path, std::atomic<size_t> &progress)
+        : fd(fd), path(path), progress(progress) {}
+
+    void put(const void *data, size_t len, bool checksum = true) {
+        if (checksum) {
+            hash = fnv1a(hash, data, len);
+        }
+        const char *p = static_cast<const char *>(data);
+        while (len > 0) {
+            ssize_t n = ::write(fd, p, std::min<size_t>(len, 1 << 20));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw io_error("write failed for", path);
+            }
+            p += n;
+            len -= n;
+            progress.fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename T>
+    void put_value(T v) {
+        put(&v, sizeof(v));
+    }
+};
+
+// Bounds-checked reader over a loaded file.
+class Reader {
+private:
+    const std::string &buf;
+    const std::string &path;
+    size_t pos = 0;
+
+public:
+    Reader(const std::string &buf, const std::string &path) : buf(buf), path(path) {}
+
+    const char *take(size_t len) {
+        if (len > buf.size() - pos) {
+            throw std::runtime_error("snapshot " + path + " is truncated");
+        }
+        const char *p = buf.data() + pos;
+        pos += len;
+        return p;
+    }
+
+    template <typename T>
+    T value() {
+        T v;
+        std::memcpy(&v, take(sizeof(T)), sizeof(T));
+        return v;
+    }
+};
+
+std::string directory_of(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+}
+
+}  // namespace
+
+AsyncCheckpointer::Staged::Staged(size_t floats) : data(floats) {
+    MemoryStats::allocate(MemCategory::Workspace, "snapshot", floats * sizeof(float32));
+}
+
+AsyncCheckpointer::Staged::~Staged() {
+    MemoryStats::release(MemCategory::Workspace, "snapshot", data.size() * sizeof(float32));
+}
+
+AsyncCheckpointer::AsyncCheckpointer(const std::string &path) : path(path) {
+    writer = std::thread([this] { writer_loop(); });
+}
+
+AsyncCheckpointer::~AsyncCheckpointer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    writer.join();
+}
+
+void AsyncCheckpointer::add(const Value &v, const std::string &name) {
+    Tensor *t = v.orig ? v.orig.get() : v.ptr.get();
+    std::string key = name.empty() ? t->name : name;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (started) {
+        throw std::invalid_argument("AsyncCheckpointer::add after the first snapshot");
+    }
+    for (const Entry &e : entries) {
+        if (e.name == key) {
+            throw std::invalid_argument("AsyncCheckpointer: duplicate tensor name '" + key + "'");
+        }
+    }
+    entries.push_back(Entry{key, t, boost::intrusive_ptr<Tensor>(t)});
+    total_floats += static_cast<size_t>(t->rows) * t->cols;
+}
+
+void AsyncCheckpointer::snapshot(int64_t step, const std::string &user_state) {
+    auto start = std::chrono::steady_clock::now();
+    ProfileScope prof("snapshot", 0.0, 2.0 * sizeof(float32) * total_floats);
+    std::unique_ptr<Staged> staged;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        started = true;
+        staged = std::move(spare);
+    }
+    if (!staged) {
+        staged.reset(new Staged(total_floats));
+    }
+    float32 *dst = staged->data.data();
+    for (const Entry &e : entries) {
+        for (int i = 0; i < e.tensor->rows; i++, dst += e.tensor->cols) {
+            std::memcpy(dst, e.tensor->data[i], sizeof(float32) * e.tensor->cols);
+        }
+    }
+    staged->step = step;
+    staged->user_state = user_state;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending) {
+            counters.superseded++;
+            spare = std::move(pending);
+        }
+        pending = std::move(staged);
+        counters.requested++;
+        counters.last_stall_ms = ms_since(start);
+        counters.max_stall_ms = std::max(counters.max_stall_ms, counters.last_stall_ms);
+        counters.total_stall_ms += counters.last_stall_ms;
+    }
+    wake.notify_one();
+}
+
+bool AsyncCheckpointer::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [&] { return !pending && !writing; });
+    return counters.last_error.empty();
+}
+
+SnapshotStats AsyncCheckpointer::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    SnapshotStats s = counters;
+    s.bytes_done = writing ? progress.load(std::memory_order_relaxed) : 0;
+    return s;
+}
+
+void AsyncCheckpointer::writer_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || pending; });
+        if (!pending) {
+            return;
+        }
+        std::unique_ptr<Staged> job = std::move(pending);
+        writing = true;
+        progress.store(0, std::memory_order_relaxed);
+        counters.bytes_in_flight = total_floats * sizeof(float32);
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        std::string error;
+        try {
+            write_file(*job);
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+        double elapsed = ms_since(start);
+
+        lock.lock();
+        writing = false;
+        counters.bytes_in_flight = 0;
+        counters.last_error = error;
+        if (error.empty()) {
+            counters.written++;
+            counters.last_write_ms = elapsed;
+            counters.last_written_step = job->step;
+        } else {
+            counters.failed++;
+        }
+        if (!spare) {
+            spare = std::move(job);
+        }
+        idle.notify_all();
+    }
+}
+
+/**
+ * File layout, native endianness:
+ *   magic[8] | version u32 | tensors u32 | step i64 | user_len u64 | user_state
+ *   | per tensor: name_len u32, name, rows i32, cols i32
+ *   | tensor data, f32, in registration order | FNV-1a of all the above u64
+ */
+void AsyncCheckpointer::write_file(const Staged &staged) {
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw io_error("cannot create", tmp);
+    }
+    try {
+        FileWriter out(fd, tmp, progress);
+        out.put(MAGIC, sizeof(MAGIC));
+        out.put_value<uint32_t>(VERSION);
+        out.put_value<uint32_t>(static_cast<uint32_t>(entries.size()));
+        out.put_value<int64_t>(staged.step);
+        out.put_value<uint64_t>(staged.user_state.size());
+        out.put(staged.user_state.data(), staged.user_state.size());
+        for (const Entry &e : entries) {
+            out.put_value<uint32_t>(static_cast<uint32_t>(e.name.size()));
+            out.put(e.name.data(), e.name.size());
+            out.put_value<int32_t>(e.tensor->rows);
+            out.put_value<int32_t>(e.tensor->cols);
+        }
+        out.put(staged.data.data(), staged.data.size() * sizeof(float32));
+        uint64_t hash = out.hash;
+        out.put(&hash, sizeof(hash), false);
+        if (::fsync(fd) != 0) {
+            throw io_error("fsync failed for", tmp);
+        }
+    } catch (...) {
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        throw;
+    }
+    if (::close(fd) != 0) {
+        throw io_error("close failed for", tmp);
+    }
+    if (::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw io_error("cannot rename to", path);
+    }
+    // Make the rename itself durable.
+    std::string dir = directory_of(path);
+    int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+}
+
+bool AsyncCheckpointer::restore(int64_t *step, std::string *user_state) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::string buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (buf.size() < sizeof(MAGIC) + sizeof(uint64_t) || std::memcmp(buf.data(), MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("snapshot " + path + " has no valid header");
+    }
+    uint64_t stored;
+    std::memcpy(&stored, buf.data() + buf.size() - sizeof(stored), sizeof(stored));
+    if (fnv1a(FNV_OFFSET, buf.data(), buf.size() - sizeof(stored)) != stored) {
+        throw std::runtime_error("snapshot " + path + " failed its checksum");
+    }
+
+    Reader r(buf, path);
+    r.take(sizeof(MAGIC));
+    if (r.value<uint32_t>() != VERSION) {
+        throw std::runtime_error("snapshot " + path + " has an unsupported version");
+    }
+    uint32_t count = r.value<uint32_t>();
+    int64_t saved_step = r.value<int64_t>();
+    uint64_t user_len = r.value<uint64_t>();
+    std::string saved_state(r.take(user_len), user_len);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (count != entries.size()) {
+        throw std::runtime_error("snapshot " + path + " holds " + std::to_string(count) + " tensors, " +
+                                 std::to_string(entries.size()) + " are tracked");
+    }
+    for (const Entry &e : entries) {
+        uint32_t name_len = r.value<uint32_t>();
+        std::string name(r.take(name_len), name_len);
+        int32_t rows = r.value<int32_t>();
+        int32_t cols = r.value<int32_t>();
+        if (name != e.name || rows != e.tensor->rows || cols != e.tensor->cols) {
+            throw std::runtime_error("snapshot " + path + " entry '" + name + "' does not match tracked tensor '" +
+                                     e.name + "'");
+        }
+    }
+    for (const Entry &e : entries) {
+        for (int i = 0; i < e.tensor->rows; i++) {
+            std::memcpy(e.tensor->data[i], r.take(sizeof(float32) * e.tensor->cols), sizeof(float32) * e.tensor->cols);
+        }
+    }
+    if (step) {
+        *step = saved_step;
+    }
+    if (user_state) {
+        *user_state = saved_state;
+    }
+    return true;
+}
@@ -0,0 +1,204 @@
+#include "sparse.h"
+#include "memory_stats.h"
+#include "parallel.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+SparseTensor SparseTensor::fromDense(const Tensor &t, float32 threshold) {
+    SparseTensor s(t.rows, t.cols);
+    for (int i = 0; i < t.rows; i++) {
+        for (int j = 0; j < t.cols; j++) {
+            if (std::fabs(t.data[i][j]) > threshold) {
+                s.col_idx.push_back(j);
+                s.values.push_back(t.data[i][j]);
+            }
+        }
+        s.row_ptr[i + 1] = static_cast<int>(s.values.size());
+    }
+    return s;
+}
+
+SparseTensor SparseTensor::fromCOO(int rows, int cols, const std::vector<int> &row_ids,
+                                   const std::vector<int> &col_ids, const std::vector<float32> &vals) {
+    if (row_ids.size() != col_ids.size() || row_ids.size() != vals.size()) {
+        throw std::invalid_argument("COO row, column and value arrays must have the same length");
+    }
+    std::vector<size_t> order(vals.size());
+    std::iota(order.begin(), order.end(), 0);
+    for (size_t k = 0; k < vals.size(); k++) {
+        if (row_ids[k] < 0 || row_ids[k] >= rows || col_ids[k] < 0 || col_ids[k] >= cols) {
+            throw std::invalid_argument("COO index out of range");
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return row_ids[a] != row_ids[b] ? row_ids[a] < row_ids[b] : col_ids[a] < col_ids[b];
+    });
+
+    SparseTensor s(rows, cols);
+    int last_row = -1, last_col = -1;
+    for (size_t k : order) {
+        if (row_ids[k] == last_row && col_ids[k] == last_col) {
+            s.values.back() += vals[k];
+            continue;
+        }
+        s.col_idx.push_back(col_ids[k]);
+        s.values.push_back(vals[k]);
+        s.row_ptr[row_ids[k] + 1]++;
+        last_row = row_ids[k];
+        last_col = col_ids[k];
+    }
+    for (int i = 0; i < rows; i++) {
+        s.row_ptr[i + 1] += s.row_ptr[i];
+    }
+    return s;
+}
+
+SparseTensor SparseTensor::transpose() const {
+    SparseTensor t(cols, rows);
+    t.col_idx.resize(nnz());
+    t.values.resize(nnz());
+    for (int c : col_idx) {
+        t.row_ptr[c + 1]++;
+    }
+    for (int i = 0; i < cols; i++) {
+        t.row_ptr[i + 1] += t.row_ptr[i];
+    }
+    std::vector<int> next(t.row_ptr.begin(), t.row_ptr.end() - 1);
+    for (int i = 0; i < rows; i++) {
+        for (int p = row_ptr[i]; p < row_ptr[i + 1]; p++) {
+            int dst = next[col_idx[p]]++;
+            t.col_idx[dst] = i;
+            t.values[dst] = values[p];
+        }
+    }
+    return t;
+}
+
+void SparseTensor::buildTransposeCache() const {
+    std::call_once(cache.built, [this] {
+        auto t = std::make_shared<SparseTensor>(transpose());
+        for (int r = 0; r < t->rows; r++) {
+            if (t->row_ptr[r + 1] > t->row_ptr[r]) {
+                cache.non_empty.push_back(r);
+            }
+        }
+        cache.transposed = std::move(t);
+    });
+}
+
+const SparseTensor &SparseTensor::transposed() const {
+    buildTransposeCache();
+    return *cache.transposed;
+}
+
+const std::vector<int> &SparseTensor::nonEmptyTransposedRows() const {
+    buildTransposeCache();
+    return cache.non_empty;
+}
+
+std::vector<int> SparseTensor::balancedRowBlocks(int parts) const {
+    std::vector<int> bounds(1, 0);
+    size_t total = nnz();
+    parts = std::max(1, std::min(parts, rows));
+    for (int b = 1; b < parts; b++) {
+        // First row whose prefix nnz reaches b/parts of the total.
+        size_t target = total * b / parts;
+        int row = static_cast<int>(std::lower_bound(row_ptr.begin(), row_ptr.end(), static_cast<int>(target)) - row_ptr.begin());
+        row = std::max(row, bounds.back());
+        if (row < rows) {
+            bounds.push_back(row);
+        }
+    }
+    bounds.push_back(rows);
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    return bounds;
+}
+
+namespace {
+
+// Below this many multiply-adds a single thread is faster.
+constexpr double PARALLEL_WORK = 1 << 15;
+
+int block_count(size_t nnz, int width) {
+    return static_cast<double>(nnz) * width >= PARALLEL_WORK ? num_threads() : 1;
+}
+
+// out[i] += sum_p values[p] * dense[col_idx[p]] over rows of `s` in `blocks`.
+void csr_times_dense(const SparseTensor &s, float32 **dense, float32 **out, int width,
+                     const std::vector<int> &blocks) {
+    parallel_for(0, static_cast<int>(blocks.size()) - 1, 1, [&](int first, int last) {
+        for (int i = blocks[first]; i < blocks[last]; i++) {
+            float32 *dst = out[i];
+            for (int p = s.row_ptr[i]; p < s.row_ptr[i + 1]; p++) {
+                const float32 v = s.values[p];
+                const float32 *src = dense[s.col_idx[p]];
+                for (int j = 0; j < width; j++) {
+                    dst[j] += v * src[j];
+                }
+            }
+        }
+    });
+}
+
+struct SpmmContext : OpContext {
+    std::shared_ptr<const SparseTensor> A;
+
+    explicit SpmmContext(std::shared_ptr<const SparseTensor> A) : A(std::move(A)) {}
+
+    // dW = A^T * dOut; row r of dW only depends on row r of A^T, and only
+    // the non-empty rows of A^T are visited.
+    void backward(Tensor &node) override {
+        Tensor *W = node.left.get();
+        ProfileScope prof("backspmm", 2.0 * A->nnz() * W->cols, sizeof(float32) * 2.0 * A->nnz() * W->cols);
+        prof.shapes(W->rows, W->cols, node.rows, node.cols);
+        const SparseTensor &At = A->transposed();
+        const std::vector<int> &touched = A->nonEmptyTransposedRows();
+        const int width = W->cols;
+        int n = static_cast<int>(touched.size());
+        double per_row = n > 0 ? static_cast<double>(At.nnz()) * width / n : 1.0;
+        int min_chunk = std::max(1, static_cast<int>(PARALLEL_WORK / std::max(per_row, 1.0)));
+        parallel_for(0, n, min_chunk, [&](int begin, int end) {
+            for (int k = begin; k < end; k++) {
+                int r = touched[k];
+                float32 *dst = W->grad[r];
+                for (int p = At.row_ptr[r]; p < At.row_ptr[r + 1]; p++) {
+                    const float32 v = At.values[p];
+                    const float32 *src = node.grad[At.col_idx[p]];
+                    for (int j = 0; j < width; j++) {
+                        dst[j] += v * src[j];
+                    }
+                }
+            }
+        });
+        W->mark_rows(touched);
+        clip_gradient_rows(W->grad, W->touched_rows, W->cols);
+    }
+};
+
+}  // namespace
+
+Value spmm(std::shared_ptr<const SparseTensor> A, const Value &W) {
+    if (W.ptr->_backward == nullptr && W.orig != nullptr) {
+        W.ptr = W.orig;
+    }
+    Tensor *w = W.ptr.get();
+    if (A->cols != w->rows) {
+        throw std::invalid_argument("Matrix dimensions do not match for sparse multiplication");
+    }
+    AllocSiteScope site("spmm");
+    ProfileScope prof("spmm", 2.0 * A->nnz() * w->cols,
+                      sizeof(float32) * (2.0 * A->nnz() * w->cols + 1.0 * A->rows * w->cols));
+    prof.shapes(A->rows, w->cols, A->rows, A->cols, w->rows, w->cols);
+
+    Tensor *result = new Tensor(A->rows, w->cols);
+    Value out(result);
+    result->link(w);
+    result->name = "sparse*" + w->name;
+    csr_times_dense(*A, w->data, result->data, w->cols, A->balancedRowBlocks(block_count(A->nnz(), w->cols)));
+    result->ctx = std::make_shared<SpmmContext>(std::move(A));
+    result->_backward = &Tensor::backcontext;
+    return out;
+}
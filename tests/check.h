@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <value.h>
+
+/**
+ * @brief Minimal assertions and input factories shared by the programs in
+ * tests/ and bench/: a failed CHECK prints its location and makes the test
+ * exit non-zero.
+ */
+inline int &check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            check_failures()++;                                                \
+        }                                                                      \
+    } while (0)
+
+// Number of elements whose bit patterns differ.
+inline int mismatches(float32 **a, float32 **b, int rows, int cols) {
+    int count = 0;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            count += std::memcmp(&a[i][j], &b[i][j], sizeof(float32)) != 0;
+        }
+    }
+    return count;
+}
+
+inline int test_result() {
+    if (check_failures() > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", check_failures());
+        return 1;
+    }
+    return 0;
+}
+
+// `n` values drawn uniformly from [-scale, scale) by mt19937(seed).
+inline std::vector<float32> random_values(size_t n, unsigned seed, float scale = 0.5f) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float32> dis(-scale, scale);
+    std::vector<float32> values(n);
+    for (float32 &v : values) v = dis(gen);
+    return values;
+}
+
+// Leaf holding a copy of the row-major `values`.
+inline Value leaf(int rows, int cols, const std::vector<float32> &values, const std::string &name,
+                  MemCategory category = MemCategory::Parameter) {
+    std::vector<float32 *> row_ptrs(rows);
+    for (int i = 0; i < rows; i++) {
+        row_ptrs[i] = const_cast<float32 *>(values.data()) + static_cast<size_t>(i) * cols;
+    }
+    return Value(rows, cols, row_ptrs.data(), name, category);
+}
+
+inline Value random_leaf(int rows, int cols, const std::string &name, unsigned seed, float scale = 0.5f,
+                         MemCategory category = MemCategory::Parameter) {
+    return leaf(rows, cols, random_values(static_cast<size_t>(rows) * cols, seed, scale), name, category);
+}
@@ -0,0 +1,72 @@
+#include <checkpoint.h>
+#include <memory_stats.h>
+#include <string>
+#include <vector>
+#include "check.h"
+
+/**
+ * @brief Gradients through checkpointed segments must be bit-identical to
+ * the eager graph, for the parameters and for the input, while the
+ * activation peak of the step is lower.
+ */
+
+namespace {
+
+const int LAYERS = 8;
+
+// Eight leaky-relu layers, checkpointed two at a time.
+struct Model {
+    Value x = random_leaf(64, 8, "x", 1);
+    Value y = random_leaf(64, 1, "y", 2);
+    std::vector<Value> W;
+    Value W_out = random_leaf(32, 1, "W_out", 3);
+
+    Model() {
+        for (int l = 0; l < LAYERS; l++) {
+            W.push_back(random_leaf(l == 0 ? 8 : 32, 32, "W" + std::to_string(l), 10 + l));
+        }
+    }
+
+    // Returns the activation peak of the step, in bytes above what was live before it.
+    size_t step(bool checkpointed) {
+        size_t before = MemoryStats::live(MemCategory::Activation);
+        MemoryStats::resetPeak();
+        Value h = x;
+        for (int l = 0; l < LAYERS; l += 2) {
+            Segment block = [this, l](const Value &v) {
+                return ((v * W[l]).leakyrelu() * W[l + 1]).leakyrelu();
+            };
+            h = checkpoint(block, h, checkpointed);
+        }
+        Value loss = (h * W_out).mse(y);
+        loss.backward();
+        return MemoryStats::peak(MemCategory::Activation) - before;
+    }
+};
+
+}  // namespace
+
+int main()
+{
+    Model eager, replayed;
+    size_t eager_peak = eager.step(false);
+    size_t replayed_peak = replayed.step(true);
+    std::printf("activation peak: eager %zu bytes, checkpointed %zu bytes\n", eager_peak, replayed_peak);
+    CHECK(replayed_peak < eager_peak);
+
+    for (int l = 0; l < LAYERS; l++) {
+        CHECK(mismatches(eager.W[l].orig->grad, replayed.W[l].orig->grad, l == 0 ? 8 : 32, 32) == 0);
+    }
+    CHECK(mismatches(eager.W_out.orig->grad, replayed.W_out.orig->grad, 32, 1) == 0);
+    CHECK(mismatches(eager.x.orig->grad, replayed.x.orig->grad, 64, 8) == 0);
+
+    // A non-trivial gradient actually reached the first layer.
+    bool nonzero = false;
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 32; j++) {
+            nonzero = nonzero || eager.W[0].orig->grad[i][j] != 0.0f;
+        }
+    }
+    CHECK(nonzero);
+    return test_result();
+}
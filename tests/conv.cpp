@@ -0,0 +1,104 @@
+#include <conv.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "check.h"
+
+/**
+ * @brief conv2d's backward (GEMM dWeight, col2im dInput, and the pointwise
+ * path) must match a naive direct-convolution backward, with clipping off.
+ */
+
+namespace {
+
+ConvSpec spec2d(int channels, int height, int width, int kernel, int stride, int pad, int dilation) {
+    ConvSpec s;
+    s.channels = channels;
+    s.height = height;
+    s.width = width;
+    s.kernel_h = s.kernel_w = kernel;
+    s.stride_h = s.stride_w = stride;
+    s.pad_h = s.pad_w = pad;
+    s.dilation_h = s.dilation_w = dilation;
+    return s;
+}
+
+// Gradients of the direct convolution, straight from its definition.
+void direct_backward(const Tensor &in, const Tensor &w, const ConvSpec &s, const std::vector<float> &dout,
+                     std::vector<float> &din, std::vector<float> &dw) {
+    const int OH = s.out_h(), OW = s.out_w(), C = s.channels, F = w.cols;
+    din.assign(static_cast<size_t>(in.rows) * in.cols, 0.0f);
+    dw.assign(static_cast<size_t>(w.rows) * F, 0.0f);
+    for (int n = 0; n < in.rows; n++) {
+        for (int oh = 0; oh < OH; oh++) {
+            for (int ow = 0; ow < OW; ow++) {
+                for (int f = 0; f < F; f++) {
+                    const float g = dout[((static_cast<size_t>(n) * OH + oh) * OW + ow) * F + f];
+                    for (int kh = 0; kh < s.kernel_h; kh++) {
+                        for (int kw = 0; kw < s.kernel_w; kw++) {
+                            const int ih = oh * s.stride_h - s.pad_h + kh * s.dilation_h;
+                            const int iw = ow * s.stride_w - s.pad_w + kw * s.dilation_w;
+                            if (ih < 0 || ih >= s.height || iw < 0 || iw >= s.width) {
+                                continue;
+                            }
+                            for (int c = 0; c < C; c++) {
+                                const int k = (kh * s.kernel_w + kw) * C + c;
+                                const size_t i = (ih * s.width + iw) * C + c;
+                                din[static_cast<size_t>(n) * in.cols + i] += g * w.data[k][f];
+                                dw[static_cast<size_t>(k) * F + f] += g * in.data[n][i];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+float max_diff(float32 **a, const std::vector<float> &b, int rows, int cols) {
+    float worst = 0.0f;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            worst = std::max(worst, std::fabs(a[i][j] - b[static_cast<size_t>(i) * cols + j]));
+        }
+    }
+    return worst;
+}
+
+void check_case(const char *name, int batch, int filters, const ConvSpec &s, unsigned seed) {
+    Value x = random_leaf(batch, s.height * s.width * s.channels, "x", seed, 1.0f);
+    Value w = random_leaf(s.patch(), filters, "w", seed + 1, 1.0f);
+    Value out = conv2d(x, w, s);
+    CHECK(out.ptr->cols == s.out_h() * s.out_w() * filters);
+
+    // Push a random output gradient through the conv node.
+    std::vector<float> dout = random_values(static_cast<size_t>(out.ptr->rows) * out.ptr->cols, seed + 2, 1.0f);
+    for (int i = 0; i < out.ptr->rows; i++) {
+        std::copy(dout.begin() + static_cast<size_t>(i) * out.ptr->cols,
+                  dout.begin() + static_cast<size_t>(i + 1) * out.ptr->cols, out.ptr->grad[i]);
+    }
+    out.ptr->propagate();
+
+    std::vector<float> din, dw;
+    direct_backward(*x.orig, *w.orig, s, dout, din, dw);
+    float din_diff = max_diff(x.orig->grad, din, x.orig->rows, x.orig->cols);
+    float dw_diff = max_diff(w.orig->grad, dw, w.orig->rows, w.orig->cols);
+    std::printf("%-24s max |dInput diff| %g, max |dWeight diff| %g\n", name, din_diff, dw_diff);
+    CHECK(din_diff < 1e-4f);
+    CHECK(dw_diff < 1e-4f);
+}
+
+}  // namespace
+
+int main()
+{
+    set_gradient_clipping(false);
+    check_case("3x3 pad1", 2, 4, spec2d(3, 6, 5, 3, 1, 1, 1), 1);
+    check_case("3x3 stride2 pad1", 2, 4, spec2d(3, 7, 7, 3, 2, 1, 1), 10);
+    check_case("3x3 dilation2 pad2", 2, 3, spec2d(2, 8, 8, 3, 1, 2, 2), 20);
+    check_case("2x2 stride3 (gaps)", 2, 3, spec2d(2, 8, 8, 2, 3, 0, 1), 30);
+    check_case("1x1 pointwise", 3, 5, spec2d(4, 5, 5, 1, 1, 0, 1), 40);
+    check_case("1d k5 stride2 dil2", 2, 4, ConvSpec::conv1d(3, 20, 5, 2, 3, 2), 50);
+    return test_result();
+}
@@ -0,0 +1,91 @@
+#include <data_parallel.h>
+#include <cmath>
+#include <csignal>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "check.h"
+
+/**
+ * @brief Data-parallel training must follow a plain single-process
+ * backward() and update() loop: bit for bit with one worker, closely with
+ * four. A worker killed by a signal must make train() throw instead of
+ * hanging.
+ */
+
+namespace {
+
+struct Data {
+    Value x = random_leaf(128, 2, "x", 1, 3.0f);
+    Value y = random_leaf(128, 1, "y", 2, 1.0f);
+};
+
+// The loop main.cpp runs, with per-node clipping on.
+std::vector<float> train_plain(int steps) {
+    Data d;
+    Value W1 = random_leaf(2, 32, "W1", 3, 0.5f);
+    Value W2 = random_leaf(32, 1, "W2", 4, 0.5f);
+    std::vector<float> losses;
+    for (int s = 0; s < steps; s++) {
+        Value loss = ((d.x * W1).leakyrelu() * W2).mse(d.y);
+        losses.push_back(loss.item());
+        loss.backward();
+        W1.update(0.01f);
+        W2.update(0.01f);
+        W1.setgradzero();
+        W2.setgradzero();
+    }
+    return losses;
+}
+
+std::vector<float> train(int workers, int steps, int kill_step = -1) {
+    Data d;
+    Value W1 = random_leaf(2, 32, "W1", 3, 0.5f);
+    Value W2 = random_leaf(32, 1, "W2", 4, 0.5f);
+
+    DataParallelConfig cfg;
+    cfg.workers = workers;
+    cfg.learning_rate = 0.01f;
+    DataParallelTrainer trainer({&W1, &W2}, cfg);
+    return trainer.train(steps, [&](int rank, int world, int step) {
+        if (rank == 1 && step == kill_step) {
+            std::raise(SIGKILL);
+        }
+        Value xs = shard_rows(d.x, rank, world);
+        Value ys = shard_rows(d.y, rank, world);
+        Value loss = ((xs * W1).leakyrelu() * W2).mse(ys);
+        float value = loss.item();
+        loss.backward();
+        return value;
+    });
+}
+
+}  // namespace
+
+int main()
+{
+    const int steps = 200;
+    std::vector<float> plain = train_plain(steps);
+    std::vector<float> single = train(1, steps);
+    std::vector<float> sharded = train(4, steps);
+    CHECK(single.size() == static_cast<size_t>(steps));
+    CHECK(sharded.size() == static_cast<size_t>(steps));
+    CHECK(single == plain);
+    float worst = 0.0f;
+    for (size_t s = 0; s < plain.size() && s < sharded.size(); s++) {
+        worst = std::max(worst, std::fabs(plain[s] - sharded[s]) / plain[s]);
+    }
+    std::printf("max relative loss difference, plain loop vs 4 workers: %g\n", worst);
+    CHECK(worst < 1e-5f);
+    CHECK(plain.back() < 0.5f * plain.front());
+
+    bool threw = false;
+    try {
+        train(4, steps, 3);
+    } catch (const std::runtime_error &e) {
+        std::printf("killed worker: %s\n", e.what());
+        threw = true;
+    }
+    CHECK(threw);
+    return test_result();
+}
@@ -0,0 +1,88 @@
+#include <embedding.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include "check.h"
+
+/**
+ * @brief embedding() with repeated ids must match one-hot(ids) * table:
+ * output, table gradient, and the table after update_rows() vs update().
+ * Empty id lists give an empty result; out-of-range ids throw.
+ */
+
+namespace {
+
+const int VOCAB = 50, DIM = 8;
+const float LEARNING_RATE = 0.1f;
+
+Value one_hot(const std::vector<int> &ids) {
+    std::vector<float> values(ids.size() * VOCAB, 0.0f);
+    for (size_t k = 0; k < ids.size(); k++) {
+        values[k * VOCAB + ids[k]] = 1.0f;
+    }
+    return leaf(static_cast<int>(ids.size()), VOCAB, values, "onehot", MemCategory::Activation);
+}
+
+void seed_grad(const Value &out, unsigned seed) {
+    const int rows = out.ptr->rows;
+    std::vector<float> dout = random_values(static_cast<size_t>(rows) * DIM, seed, 1.0f);
+    for (int i = 0; i < rows; i++) {
+        std::copy(dout.begin() + static_cast<size_t>(i) * DIM, dout.begin() + static_cast<size_t>(i + 1) * DIM,
+                  out.ptr->grad[i]);
+    }
+    out.ptr->propagate();
+}
+
+}  // namespace
+
+int main()
+{
+    Value table_sparse = random_leaf(VOCAB, DIM, "table", 1, 1.0f);
+    Value table_dense = random_leaf(VOCAB, DIM, "table", 1, 1.0f);
+    const std::vector<std::vector<int>> batches = {
+        {3, 7, 3, 49, 0, 7, 3},
+        {12, 12, 12, 12},
+        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 49},
+    };
+
+    for (size_t step = 0; step < batches.size(); step++) {
+        const std::vector<int> &ids = batches[step];
+        const int n = static_cast<int>(ids.size());
+        Value sparse_out = embedding(table_sparse, ids);
+        Value onehot = one_hot(ids);
+        Value dense_out = onehot * table_dense;
+        CHECK(mismatches(sparse_out.ptr->data, dense_out.ptr->data, n, DIM) == 0);
+
+        seed_grad(sparse_out, 10 + step);
+        seed_grad(dense_out, 10 + step);
+        CHECK(mismatches(table_sparse.orig->grad, table_dense.orig->grad, VOCAB, DIM) == 0);
+        std::vector<int> unique_ids = ids;
+        std::sort(unique_ids.begin(), unique_ids.end());
+        unique_ids.erase(std::unique(unique_ids.begin(), unique_ids.end()), unique_ids.end());
+        CHECK(table_sparse.orig->touched_rows == unique_ids);
+
+        table_sparse.update_rows(LEARNING_RATE);
+        table_dense.update(LEARNING_RATE);
+        table_dense.setgradzero();
+        CHECK(table_sparse.orig->touched_rows.empty());
+        CHECK(mismatches(table_sparse.orig->data, table_dense.orig->data, VOCAB, DIM) == 0);
+        CHECK(mismatches(table_sparse.orig->grad, table_dense.orig->grad, VOCAB, DIM) == 0);
+    }
+
+    // No ids: an empty result whose backward touches nothing.
+    Value empty = embedding(table_sparse, {});
+    CHECK(empty.ptr->rows == 0 && empty.ptr->cols == DIM);
+    empty.ptr->propagate();
+    CHECK(table_sparse.orig->touched_rows.empty());
+
+    for (int bad : {-1, VOCAB}) {
+        bool threw = false;
+        try {
+            embedding(table_sparse, {1, bad});
+        } catch (const std::invalid_argument &) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+    return test_result();
+}
@@ -0,0 +1,96 @@
+#include <exporter.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "check.h"
+
+/**
+ * @brief A model written by export_model() and built with the system
+ * compiler must reproduce the library forward pass bit for bit, on the
+ * traced input and on an input it has never seen.
+ */
+
+#ifndef ESP_TEST_CXX
+#define ESP_TEST_CXX "c++"
+#endif
+
+namespace {
+
+struct Model {
+    Value W1 = random_leaf(8, 32, "W1", 3);
+    Value b1 = random_leaf(16, 32, "b1", 4);
+    Value W2 = random_leaf(32, 4, "W2", 5);
+    Value b2 = random_leaf(16, 4, "b2", 6);
+
+    Value forward(const Value &x) {
+        return ((x * W1 + b1).leakyrelu() * W2) - b2;
+    }
+};
+
+void write_array(std::ofstream &os, const char *name, const Tensor &t) {
+    os << "const float " << name << "[" << t.rows * t.cols << "] = {";
+    char buf[32];
+    for (int i = 0; i < t.rows; i++) {
+        for (int j = 0; j < t.cols; j++) {
+            std::snprintf(buf, sizeof(buf), "%a", t.data[i][j]);
+            os << buf << "f,";
+        }
+    }
+    os << "};\n";
+}
+
+int run(const std::string &command) {
+    int status = std::system(command.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+}  // namespace
+
+int main()
+{
+    char dir_template[] = "/tmp/esp_export_XXXXXX";
+    const char *dir = mkdtemp(dir_template);
+    CHECK(dir != nullptr);
+    if (!dir) return test_result();
+    std::string model_path = std::string(dir) + "/model.cpp";
+    std::string driver_path = std::string(dir) + "/driver.cpp";
+    std::string binary = std::string(dir) + "/model";
+
+    Model model;
+    Value traced_x = random_leaf(16, 8, "x", 1);
+    Value traced_out = model.forward(traced_x);
+    export_model(traced_out, traced_x, model_path);
+
+    // A second input the exported file has not seen, with its library output.
+    Value unseen_x = random_leaf(16, 8, "x_unseen", 2);
+    Value unseen_out = model.forward(unseen_x);
+    {
+        std::ofstream driver(driver_path);
+        driver << "#include \"model.cpp\"\n#include <cstdio>\n#include <cstring>\n\n";
+        write_array(driver, "unseen_input", *unseen_x.ptr);
+        write_array(driver, "unseen_output", *unseen_out.ptr);
+        driver << "\nint main() {\n"
+               << "    float out[64];\n"
+               << "    esp_model(unseen_input, out);\n"
+               << "    int mismatches = esp_model_self_test();\n"
+               << "    for (int i = 0; i < 64; i++) {\n"
+               << "        mismatches += std::memcmp(&out[i], &unseen_output[i], sizeof(float)) != 0;\n"
+               << "    }\n"
+               << "    std::printf(\"exported model: %d mismatching outputs\\n\", mismatches);\n"
+               << "    return mismatches == 0 ? 0 : 1;\n"
+               << "}\n";
+    }
+
+    // Same flags the ESP_EXPORTED_MODEL target uses.
+    CHECK(run(std::string(ESP_TEST_CXX) + " -O2 -ffp-contract=off -o " + binary + " " + driver_path) == 0);
+    CHECK(run(binary) == 0);
+
+    std::remove(binary.c_str());
+    std::remove(driver_path.c_str());
+    std::remove(model_path.c_str());
+    rmdir(dir);
+    return test_result();
+}
@@ -0,0 +1,75 @@
+#include <lazy.h>
+#include <memory_stats.h>
+#include <algorithm>
+#include <vector>
+#include "check.h"
+
+/**
+ * @brief A fused (A + B - C).leakyrelu() must give the eager chain's
+ * values and input gradients, with clipping off, while keeping one tensor
+ * alive instead of three.
+ */
+
+namespace {
+
+const int ROWS = 64, COLS = 300;  // more than one column tile
+
+struct Inputs {
+    Value A = random_leaf(ROWS, COLS, "A", 1, 1.0f);
+    Value B = random_leaf(ROWS, COLS, "B", 2, 1.0f);
+    Value C = random_leaf(ROWS, COLS, "C", 3, 1.0f);
+};
+
+long live_allocations() {
+    long count = 0;
+    for (const SiteUsage &site : MemoryStats::sites()) {
+        count += site.live_allocations;
+    }
+    return count;
+}
+
+// Push the same random output gradient through `out`.
+void backward_from(const Value &out) {
+    std::vector<float> dout = random_values(static_cast<size_t>(ROWS) * COLS, 4, 1.0f);
+    for (int i = 0; i < ROWS; i++) {
+        std::copy(dout.begin() + static_cast<size_t>(i) * COLS, dout.begin() + static_cast<size_t>(i + 1) * COLS,
+                  out.ptr->grad[i]);
+    }
+    out.ptr->propagate();
+}
+
+}  // namespace
+
+int main()
+{
+    set_gradient_clipping(false);
+    Inputs eager, fused;
+
+    size_t bytes_before = MemoryStats::liveTotal();
+    long allocations_before = live_allocations();
+    Value eager_out = (eager.A + eager.B - eager.C).leakyrelu();
+    size_t eager_bytes = MemoryStats::liveTotal() - bytes_before;
+    long eager_allocations = live_allocations() - allocations_before;
+
+    bytes_before = MemoryStats::liveTotal();
+    allocations_before = live_allocations();
+    Value fused_out = (lazy(fused.A) + fused.B - fused.C).leakyrelu();
+    size_t fused_bytes = MemoryStats::liveTotal() - bytes_before;
+    long fused_allocations = live_allocations() - allocations_before;
+
+    std::printf("held by the graph: eager %zu bytes in %ld buffers, fused %zu bytes in %ld buffers\n",
+                eager_bytes, eager_allocations, fused_bytes, fused_allocations);
+    CHECK(fused_bytes > 0);
+    CHECK(3 * fused_bytes == eager_bytes);
+    CHECK(3 * fused_allocations == eager_allocations);
+
+    CHECK(mismatches(eager_out.ptr->data, fused_out.ptr->data, ROWS, COLS) == 0);
+
+    backward_from(eager_out);
+    backward_from(fused_out);
+    CHECK(mismatches(eager.A.orig->grad, fused.A.orig->grad, ROWS, COLS) == 0);
+    CHECK(mismatches(eager.B.orig->grad, fused.B.orig->grad, ROWS, COLS) == 0);
+    CHECK(mismatches(eager.C.orig->grad, fused.C.orig->grad, ROWS, COLS) == 0);
+    CHECK(fused.C.orig->grad[0][0] != 0.0f);
+    return test_result();
+}
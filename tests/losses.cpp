@@ -0,0 +1,138 @@
+#include <value.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include "check.h"
+
+/**
+ * @brief Gradients of sum, mean, mse and cross_entropy against finite
+ * differences, with clipping on: no loss root clips what it emits. Also
+ * checks how backward() seeds: only 1x1 sum/mean/loss roots get 1,
+ * backward(seed) scales the gradient and needs a 1x1 root.
+ */
+
+namespace {
+
+typedef std::function<Value(const Value &)> Loss;
+
+// Largest |analytic - central difference| over every element of x.
+float gradient_error(const Loss &loss, int rows, int cols, unsigned seed) {
+    std::vector<float> values = random_values(static_cast<size_t>(rows) * cols, seed, 2.0f);
+    Value x = leaf(rows, cols, values, "x");
+    loss(x).backward();
+
+    const float h = 1e-2f;
+    float worst = 0.0f;
+    for (size_t k = 0; k < values.size(); k++) {
+        std::vector<float> plus = values, minus = values;
+        plus[k] += h;
+        minus[k] -= h;
+        float up = loss(leaf(rows, cols, plus, "x")).item();
+        float down = loss(leaf(rows, cols, minus, "x")).item();
+        float numeric = (up - down) / (2 * h);
+        worst = std::max(worst, std::fabs(numeric - x.orig->grad[k / cols][k % cols]));
+    }
+    return worst;
+}
+
+// Rows that sum to one, as cross_entropy expects.
+Value soft_targets(int rows, int cols) {
+    std::vector<float> values = random_values(static_cast<size_t>(rows) * cols, 99, 1.0f);
+    for (int i = 0; i < rows; i++) {
+        float total = 0.0f;
+        for (int j = 0; j < cols; j++) {
+            float &v = values[static_cast<size_t>(i) * cols + j];
+            v = std::fabs(v);
+            total += v;
+        }
+        for (int j = 0; j < cols; j++) {
+            values[static_cast<size_t>(i) * cols + j] /= total;
+        }
+    }
+    return leaf(rows, cols, values, "t", MemCategory::Activation);
+}
+
+bool all_equal(float32 **grad, int rows, int cols, float expected) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            if (grad[i][j] != expected) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main()
+{
+    // Gradients far above CLIP_NORM must come out unchanged.
+    {
+        Value x = random_leaf(40, 40, "x", 1);
+        x.sum().backward();
+        CHECK(all_equal(x.orig->grad, 40, 40, 1.0f));
+    }
+    {
+        Value x = random_leaf(4, 5, "x", 2);
+        x.mean().backward();
+        CHECK(all_equal(x.orig->grad, 4, 5, 1.0f / 20));
+    }
+
+    Value y = random_leaf(6, 4, "y", 3, 2.0f, MemCategory::Activation);
+    Value t = soft_targets(6, 4);
+    float sum_error = gradient_error([](const Value &x) { return x.sum(); }, 6, 4, 10);
+    float mean_error = gradient_error([](const Value &x) { return x.mean(); }, 6, 4, 11);
+    float mse_error = gradient_error([&](const Value &x) { return x.mse(y); }, 6, 4, 12);
+    float ce_error = gradient_error([&](const Value &x) { return x.cross_entropy(t); }, 6, 4, 13);
+    std::printf("max |grad - finite difference|: sum %g, mean %g, mse %g, cross_entropy %g\n",
+                sum_error, mean_error, mse_error, ce_error);
+    CHECK(sum_error < 1e-3f);
+    CHECK(mean_error < 1e-3f);
+    CHECK(mse_error < 1e-3f);
+    CHECK(ce_error < 1e-3f);
+
+    // backward(seed) scales the loss gradient.
+    {
+        Value a = random_leaf(6, 4, "a", 4);
+        Value b = random_leaf(6, 4, "b", 4);
+        a.mse(y).backward();
+        b.mse(y).backward(2.5f);
+        bool scaled = true;
+        for (int i = 0; i < 6; i++) {
+            for (int j = 0; j < 4; j++) {
+                float expected = 2.5f * a.orig->grad[i][j];
+                scaled = scaled && std::fabs(b.orig->grad[i][j] - expected) <= 1e-6f * std::fabs(expected);
+            }
+        }
+        CHECK(scaled);
+    }
+
+    // A 1x1 product is not a loss: backward() propagates the zero grad it holds.
+    {
+        Value u = random_leaf(1, 5, "u", 5);
+        Value v = random_leaf(5, 1, "v", 6);
+        (u * v).backward();
+        CHECK(all_equal(u.orig->grad, 1, 5, 0.0f));
+        (u * v).backward(1.0f);
+        CHECK(u.orig->grad[0][0] != 0.0f);
+    }
+
+    // Nor is a per-column sum, and backward(seed) refuses it.
+    {
+        Value x = random_leaf(3, 4, "x", 7);
+        Value columns = x.sum(0);
+        columns.backward();
+        CHECK(all_equal(x.orig->grad, 3, 4, 0.0f));
+        bool threw = false;
+        try {
+            columns.backward(1.0f);
+        } catch (const std::invalid_argument &) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+    return test_result();
+}
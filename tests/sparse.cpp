@@ -0,0 +1,89 @@
+#include <sparse.h>
+#include <algorithm>
+#include <vector>
+#include "check.h"
+
+/**
+ * @brief spmm must match the dense operator* on the same matrix: output,
+ * row-sparse dW, and weights after update_rows() vs update(). Only the
+ * columns A actually uses may be touched, and the cached transpose must be
+ * built once and reused.
+ */
+
+namespace {
+
+const int N = 12, D = 40, H = 6;
+const float LEARNING_RATE = 0.1f;
+
+// Rows of dense x with about one entry in eight kept, and every column
+// that is a multiple of 5 left empty.
+std::vector<float> sparse_values() {
+    std::vector<float> values = random_values(static_cast<size_t>(N) * D, 1, 1.0f);
+    std::vector<float> keep = random_values(values.size(), 2, 1.0f);
+    for (size_t k = 0; k < values.size(); k++) {
+        if (keep[k] < 0.75f || (k % D) % 5 == 0) {
+            values[k] = 0.0f;
+        }
+    }
+    return values;
+}
+
+void seed_grad(const Value &out, unsigned seed) {
+    std::vector<float> dout = random_values(static_cast<size_t>(N) * H, seed, 1.0f);
+    for (int i = 0; i < N; i++) {
+        std::copy(dout.begin() + static_cast<size_t>(i) * H, dout.begin() + static_cast<size_t>(i + 1) * H,
+                  out.ptr->grad[i]);
+    }
+    out.ptr->propagate();
+}
+
+}  // namespace
+
+int main()
+{
+    set_gradient_clipping(false);
+    Value X = leaf(N, D, sparse_values(), "x", MemCategory::Activation);
+    auto A = std::make_shared<const SparseTensor>(SparseTensor::fromDense(*X.ptr));
+    Value W_sparse = random_leaf(D, H, "W", 3, 1.0f);
+    Value W_dense = random_leaf(D, H, "W", 3, 1.0f);
+
+    std::vector<int> used;
+    for (int c = 0; c < D; c++) {
+        for (int r = 0; r < N; r++) {
+            if (X.ptr->data[r][c] != 0.0f) {
+                used.push_back(c);
+                break;
+            }
+        }
+    }
+    CHECK(used.size() > 0 && used.size() < static_cast<size_t>(D));
+
+    for (int step = 0; step < 3; step++) {
+        Value sparse_out = spmm(A, W_sparse);
+        Value dense_out = X * W_dense;
+        CHECK(mismatches(sparse_out.ptr->data, dense_out.ptr->data, N, H) == 0);
+
+        seed_grad(sparse_out, 10 + step);
+        seed_grad(dense_out, 10 + step);
+        CHECK(mismatches(W_sparse.orig->grad, W_dense.orig->grad, D, H) == 0);
+        CHECK(W_sparse.orig->touched_rows == used);
+
+        W_sparse.update_rows(LEARNING_RATE);
+        W_dense.update(LEARNING_RATE);
+        W_dense.setgradzero();
+        X.setgradzero();
+        CHECK(W_sparse.orig->touched_rows.empty());
+        CHECK(mismatches(W_sparse.orig->data, W_dense.orig->data, D, H) == 0);
+        CHECK(mismatches(W_sparse.orig->grad, W_dense.orig->grad, D, H) == 0);
+    }
+
+    // The transpose is built once, matches transpose(), and is not shared with copies.
+    const SparseTensor &At = A->transposed();
+    CHECK(&At == &A->transposed());
+    SparseTensor expected = A->transpose();
+    CHECK(At.row_ptr == expected.row_ptr && At.col_idx == expected.col_idx && At.values == expected.values);
+    CHECK(A->nonEmptyTransposedRows() == used);
+    SparseTensor copy = *A;
+    CHECK(&copy.transposed() != &At);
+    return test_result();
+}
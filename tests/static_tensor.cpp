@@ -0,0 +1,60 @@
+#include <static_tensor.h>
+#include <vector>
+#include "check.h"
+
+/**
+ * @brief A graph mixing Values with constant StaticTensor operands must
+ * give the same outputs and input gradients, bit for bit, as the same graph
+ * built from Values only.
+ */
+
+namespace {
+
+template <int R, int C>
+StaticTensor<R, C> make_static(const std::vector<float> &values) {
+    StaticTensor<R, C> s;
+    for (int i = 0; i < R; i++) {
+        for (int j = 0; j < C; j++) {
+            s[i][j] = values[i * C + j];
+        }
+    }
+    return s;
+}
+
+}  // namespace
+
+int main()
+{
+    std::vector<float> x_values = random_values(8 * 4, 1, 1.0f);
+    std::vector<float> w_values = random_values(4 * 16, 2, 1.0f);
+    std::vector<float> b_values = random_values(8 * 16, 3, 1.0f);
+    std::vector<float> y_values = random_values(8 * 16, 4, 1.0f);
+    std::vector<float> p_values = random_values(2 * 8, 5, 1.0f);
+    std::vector<float> t_values = random_values(2 * 16, 6, 1.0f);
+    Value target = leaf(2, 16, t_values, "t");
+
+    // out = P * (Y - (B + x * W).leakyrelu()), with P, Y, B and W as Values...
+    Value x_dynamic = leaf(8, 4, x_values, "x");
+    Value W = leaf(4, 16, w_values, "W");
+    Value B = leaf(8, 16, b_values, "B");
+    Value Y = leaf(8, 16, y_values, "Y");
+    Value P = leaf(2, 8, p_values, "P");
+    Value dynamic_out = P * (Y - (B + x_dynamic * W).leakyrelu());
+    std::vector<float> dynamic_data(dynamic_out.ptr->data[0], dynamic_out.ptr->data[0] + 2 * 16);
+    dynamic_out.mse(target).backward();
+
+    // ...and as constant StaticTensors.
+    Value x_static = leaf(8, 4, x_values, "x");
+    auto Ws = make_static<4, 16>(w_values);
+    auto Bs = make_static<8, 16>(b_values);
+    auto Ys = make_static<8, 16>(y_values);
+    auto Ps = make_static<2, 8>(p_values);
+    Value static_out = Ps * (Ys - (Bs + x_static * Ws).leakyrelu());
+    std::vector<float> static_data(static_out.ptr->data[0], static_out.ptr->data[0] + 2 * 16);
+    static_out.mse(target).backward();
+
+    CHECK(dynamic_data == static_data);
+    CHECK(mismatches(x_dynamic.orig->grad, x_static.orig->grad, 8, 4) == 0);
+    CHECK(x_static.orig->grad[0][0] != 0.0f || x_static.orig->grad[1][1] != 0.0f);
+    return test_result();
+}